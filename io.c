@@ -31,14 +31,20 @@
  * SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE     /* memmem() */
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "ttyrec.h"
+#include "io.h"
+#include "zio.h"
+#include "pack.h"
 
 #define SWAP_ENDIAN(val) ((unsigned int) ( \
     (((unsigned int) (val) & (unsigned int) 0x000000ffU) << 24) | \
@@ -78,27 +84,770 @@ convert_to_little_endian (int x)
     }
 }
 
+static char *progname = "";
+void
+set_progname (const char *name)
+{
+    progname = strdup(name);
+}
+
+const char *
+get_progname ()
+{
+    return progname;
+}
+
+/* Streams opened by ttyopen() in a format other than plain get their 
+    state kept here, found by FILE pointer. Plain ones are not here, so 
+    read_header() on any FILE works as it always has. */
+typedef struct TTYSTREAM
+{
+    FILE *fp;
+    int format;
+    long data_start, data_end;  /* records are between these */
+    long next_pos;              /* start of record after the last read */
+    struct timeval next_base;   /* its time delta is from this */
+    long last_pos;              /* start of last record read, for rereads */
+    struct timeval last_base;
+    Lite_Sync *sync;            /* footer index */
+    int sync_count;
+} TtyStream;
+
+static TtyStream **streams = NULL;
+static int stream_count = 0;
+
+/* Recordings may be opened and read by several threads, each stream by
+    one at a time. The streams kept here, and the cache of packs, are 
+    guarded by io_lock; zio.c keeps dictionaries and gzip checkpoints 
+    under locks of its own. The lock is not held while a file is opened
+    and its format set up, so a compressed one being inflated does not
+    hold up the others. Each thread remembers the stream it looked up 
+    last, until any stream is opened or closed, so reading records does
+    not contend for the lock. */
+static pthread_mutex_t io_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static unsigned int stream_gen = 0;    /* bumped as streams come and go */
+static __thread FILE *seen_fp = NULL;
+static __thread TtyStream *seen_st = NULL;
+static __thread unsigned int seen_gen = 0;
+
+static TtyStream *
+find_stream (FILE *fp)
+{
+    unsigned int gen = __atomic_load_n(&stream_gen, __ATOMIC_ACQUIRE);
+    TtyStream *st = NULL;
+    int i;
+
+    if (fp == seen_fp && gen == seen_gen) {
+	return seen_st;
+    }
+    pthread_mutex_lock(&io_lock);
+    for (i = 0; i < stream_count; i++) {
+	if (streams[i]->fp == fp) {
+	    st = streams[i];
+	    break;
+	}
+    }
+    seen_fp = fp;
+    seen_st = st;
+    seen_gen = stream_gen;
+    pthread_mutex_unlock(&io_lock);
+    return st;
+}
+
+static void
+forget_stream (FILE *fp)
+{
+    int i;
+
+    pthread_mutex_lock(&io_lock);
+    for (i = 0; i < stream_count; i++) {
+	if (streams[i]->fp == fp) {
+	    free(streams[i]->sync);
+	    free(streams[i]);
+	    streams[i] = streams[--stream_count];
+	    break;
+	}
+    }
+    __atomic_add_fetch(&stream_gen, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&io_lock);
+}
+
+static TtyStream *
+new_stream (FILE *fp, int format)
+{
+    TtyStream *st = emalloc(sizeof(TtyStream));
+
+    memset(st, 0, sizeof(TtyStream));
+    st->fp = fp;
+    st->format = format;
+    st->data_end = LONG_MAX;
+    st->next_pos = st->last_pos = -1;
+    pthread_mutex_lock(&io_lock);
+    streams = realloc(streams, (stream_count + 1) * sizeof(TtyStream *));
+    assert(streams != NULL);
+    streams[stream_count++] = st;
+    __atomic_add_fetch(&stream_gen, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&io_lock);
+    return st;
+}
+
+/* little endian integers of any size, for file headers and footers */
+void
+put_le (unsigned char *p, unsigned long long x, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+	p[i] = x >> (8 * i);
+    }
+}
+
+unsigned long long
+get_le (const unsigned char *p, int size)
+{
+    unsigned long long x = 0;
+    int i;
+
+    for (i = size - 1; i >= 0; i--) {
+	x = (x << 8) | p[i];
+    }
+    return x;
+}
+
+/* LEB128 varints, 7 bits a byte, low bits first */
+int
+put_varint (FILE *fp, unsigned long long x)
+{
+    unsigned char buf[10];
+    int n = 0;
+
+    do {
+	buf[n] = x & 0x7f;
+	x >>= 7;
+	if (x) {
+	    buf[n] |= 0x80;
+	}
+	n++;
+    } while (x);
+    return fwrite(buf, 1, n, fp) == n;
+}
+
+int
+get_varint (FILE *fp, unsigned long long *x)
+{
+    int c, shift = 0;
+
+    *x = 0;
+    do {
+	if ((c = getc(fp)) == EOF || shift > 63) {
+	    return 0;
+	}
+	*x |= (unsigned long long) (c & 0x7f) << shift;
+	shift += 7;
+    } while (c & 0x80);
+    return 1;
+}
+
+#define ZIGZAG(x)   (((unsigned long long) (x) << 1) ^ (unsigned long long) ((long long) (x) >> 63))
+#define UNZIGZAG(x) ((long long) ((x) >> 1) ^ -(long long) ((x) & 1))
+
+static int lite_read_header (TtyStream *st, Header *h);
+
+/* find base time for a delta record at pos, by reading forward from the
+    closest preceding sync record listed in the footer */
+static int
+lite_resync (TtyStream *st, long pos)
+{
+    int lo = 0, hi = st->sync_count;
+    Header h;
+
+    while (lo < hi) {	/* first sync record after pos */
+	int mid = (lo + hi) / 2;
+	if (st->sync[mid].offset <= pos) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    if (lo == 0) {
+	return 0;	/* no footer, or pos is garbage */
+    }
+    fseek(st->fp, st->sync[lo - 1].offset, SEEK_SET);
+    st->next_pos = st->last_pos = -1;
+    while (ftell(st->fp) < pos) {
+	if (lite_read_header(st, &h) == 0) {
+	    return 0;
+	}
+	fseek(st->fp, h.len, SEEK_CUR);
+    }
+    return st->next_pos == pos;
+}
+
+static int
+lite_read_header (TtyStream *st, Header *h)
+{
+    long pos = ftell(st->fp);
+    unsigned long long tag, sec, usec, len;
+    struct timeval base = {0, 0};
+
+    if (pos < st->data_start) {	/* start of file means first record */
+	fseek(st->fp, st->data_start, SEEK_SET);
+	pos = st->data_start;
+    }
+    if (pos >= st->data_end || get_varint(st->fp, &tag) == 0) {
+	return 0;
+    }
+
+    if (tag & 1) {		/* sync record, time is absolute */
+	if (get_varint(st->fp, &sec) == 0 || get_varint(st->fp, &usec) == 0) {
+	    return 0;
+	}
+	h->tv.tv_sec = UNZIGZAG(sec);
+	h->tv.tv_usec = usec;
+	h->nsec = 0;
+    } else {
+	long long us;
+	if (pos == st->next_pos) {
+	    base = st->next_base;
+	} else if (pos == st->last_pos) {
+	    base = st->last_base;
+	} else {		/* somebody seeked, find out where we are */
+	    if (lite_resync(st, pos) == 0) {
+		return 0;
+	    }
+	    fseek(st->fp, pos, SEEK_SET);
+	    return lite_read_header(st, h);
+	}
+	us = (long long) base.tv_sec * 1000000 + base.tv_usec + UNZIGZAG(tag >> 1);
+	h->tv.tv_sec = us / 1000000;
+	h->tv.tv_usec = us % 1000000;
+	if (h->tv.tv_usec < 0) {
+	    h->tv.tv_sec--;
+	    h->tv.tv_usec += 1000000;
+	}
+	h->nsec = 0;
+    }
+    if (get_varint(st->fp, &len) == 0 || len > LLONG_MAX) {
+	return 0;
+    }
+    h->len = len;
+
+    st->last_pos = pos;
+    st->last_base = base;
+    st->next_pos = ftell(st->fp) + h->len;
+    st->next_base = h->tv;
+    return 1;
+}
+
+static int
+ext_read_header (TtyStream *st, Header *h)
+{
+    unsigned char buf[TTYEXT_RECORD];
+    unsigned int nsec;
+
+    if (ftell(st->fp) < st->data_start) {
+	fseek(st->fp, st->data_start, SEEK_SET);
+    }
+    if (fread(buf, 1, TTYEXT_RECORD, st->fp) != TTYEXT_RECORD) {
+	return 0;
+    }
+    nsec = get_le(buf + 8, 4);
+    h->tv.tv_sec = (long long) get_le(buf, 8);
+    h->tv.tv_usec = nsec / 1000;
+    h->nsec = nsec % 1000;
+    h->len = get_le(buf + 12, 8);
+    return h->len >= 0;
+}
+
+/* write header of an extended precision file, then ext_write_header()
+    for each record */
+int
+ext_write_start (FILE *fp)
+{
+    unsigned char hdr[TTYEXT_HEADER];
+
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, TTYEXT_MAGIC, 8);
+    hdr[8] = TTYEXT_VERSION;
+    return fwrite(hdr, 1, sizeof(hdr), fp) == sizeof(hdr);
+}
+
+int
+ext_write_header (FILE *fp, Header *h)
+{
+    unsigned char buf[TTYEXT_RECORD];
+
+    put_le(buf, h->tv.tv_sec, 8);
+    put_le(buf + 8, (unsigned int) h->tv.tv_usec * 1000 + h->nsec, 4);
+    put_le(buf + 12, h->len, 8);
+    return fwrite(buf, 1, TTYEXT_RECORD, fp) == TTYEXT_RECORD;
+}
+
+/* set up reading a ttyrec-lite file, fp is just past magic */
+static void
+lite_open (FILE *fp, const char *path)
+{
+    TtyStream *st;
+    unsigned char hdr[TTYLITE_HEADER - 8], trailer[TTYLITE_TRAILER];
+    int i;
+
+    if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || hdr[0] != TTYLITE_VERSION) {
+	fprintf(stderr, "%s: %s: unsupported ttyrec-lite version\n", progname, path);
+	exit(EXIT_FAILURE);
+    }
+    st = new_stream(fp, TTYREC_LITE);
+    st->data_start = TTYLITE_HEADER;
+
+    /* footer is optional, a file still being written has none */
+    if (fseek(fp, -TTYLITE_TRAILER, SEEK_END) == 0 &&
+	fread(trailer, 1, TTYLITE_TRAILER, fp) == TTYLITE_TRAILER &&
+	memcmp(trailer + 16, TTYLITE_END, 8) == 0) {
+	unsigned char entry[24];
+	st->data_end = get_le(trailer, 8);
+	st->sync_count = get_le(trailer + 8, 4);
+	st->sync = emalloc((st->sync_count + 1) * sizeof(Lite_Sync));
+	fseek(fp, st->data_end, SEEK_SET);
+	for (i = 0; i < st->sync_count; i++) {
+	    if (fread(entry, 1, 24, fp) != 24) {
+		break;
+	    }
+	    st->sync[i].offset = get_le(entry, 8);
+	    st->sync[i].tv_sec = get_le(entry + 8, 8);
+	    st->sync[i].tv_usec = get_le(entry + 16, 4);
+	    st->sync[i].flags = get_le(entry + 20, 4);
+	}
+	st->sync_count = i;
+    }
+    fseek(fp, st->data_start, SEEK_SET);
+}
+
+/* look at start of file to tell the format, and set up reading it. 
+    Returns the stream to read, which for a compressed file is not fp. */
+static FILE *
+ttydetect (FILE *fp, const char *path)
+{
+    char magic[8];
+
+    forget_stream(fp);
+    if (fread(magic, 1, 8, fp) != 8) {
+	fseek(fp, 0, SEEK_SET);
+	return fp;
+    }
+    if (memcmp(magic, TTYZ_MAGIC, 8) == 0) {
+	return ttydetect(zio_open(fp, path), path);
+    }
+    if (memcmp(magic, GZIP_MAGIC, 2) == 0) {
+	return ttydetect(gz_open(fp, path), path);
+    }
+    if (memcmp(magic, TTYLITE_MAGIC, 8) == 0) {
+	lite_open(fp, path);
+	return fp;
+    }
+    if (memcmp(magic, TTYEXT_MAGIC, 8) == 0) {
+	if (getc(fp) != TTYEXT_VERSION) {
+	    fprintf(stderr, "%s: %s: unsupported extended ttyrec version\n", progname, path);
+	    exit(EXIT_FAILURE);
+	}
+	new_stream(fp, TTYREC_EXT)->data_start = TTYEXT_HEADER;
+	fseek(fp, TTYEXT_HEADER, SEEK_SET);
+	return fp;
+    }
+    fseek(fp, 0, SEEK_SET);	/* plain ttyrec */
+    return fp;
+}
+
+/* open a recording for reading, in whatever format it is, or one in a 
+    pack as PACK:NAME or PACK@TIME */
+FILE *
+ttyopen (const char *path)
+{
+    long start;
+    FILE *fp;
+
+    pthread_mutex_lock(&io_lock);
+    fp = pack_open(path, &start);
+    pthread_mutex_unlock(&io_lock);
+    if (fp == NULL) {
+	fp = ttydetect(efopen(path, "r"), path);
+    } else {
+	fp = ttydetect(fp, path);
+	if (start > 0) {	/* from a keyframe */
+	    fseek(fp, start, SEEK_SET);
+	}
+    }
+    return fp;
+}
+
+/* freopen() for recordings, fp may change */
+FILE *
+ttyreopen (const char *path, FILE *fp)
+{
+    if (fileno(fp) < 0) {	/* decompressed in memory, or in a pack */
+	ttyclose(fp);
+	return ttyopen(path);
+    }
+    forget_stream(fp);
+    fp = freopen(path, "r", fp);
+    if (fp == NULL) {
+	fprintf(stderr, "%s: %s: %s\n", progname, path, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    return ttydetect(fp, path);
+}
+
+int
+ttyclose (FILE *fp)
+{
+    forget_stream(fp);
+    return efclose(fp);
+}
+
+/* offset where records of fp end: the footer of ttyrec-lite, else the
+    end of file. Moves fp. */
+long
+ttydataend (FILE *fp)
+{
+    TtyStream *st = find_stream(fp);
+
+    if (st != NULL && st->data_end != LONG_MAX) {
+	return st->data_end;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0) {
+	return -1;
+    }
+    return ftell(fp);
+}
+
+int
+ttyformat (FILE *fp)
+{
+    TtyStream *st = find_stream(fp);
+
+    return st == NULL ? TTYREC_PLAIN : st->format;
+}
+
+/* Writing ttyrec-lite: lite_write_start(), then lite_write_record() for
+    each record, and lite_write_end() to add the footer. The latter two
+    return 0 if writing failed. */
+void
+lite_write_start (Lite_Writer *w, FILE *fp)
+{
+    unsigned char hdr[TTYLITE_HEADER];
+
+    memset(w, 0, sizeof(Lite_Writer));
+    w->fp = fp;
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, TTYLITE_MAGIC, 8);
+    hdr[8] = TTYLITE_VERSION;
+    fwrite(hdr, 1, sizeof(hdr), fp);
+}
+
+int
+lite_write_record (Lite_Writer *w, Header *h, const char *buf)
+{
+    int clrscr = memmem(buf, h->len, CLRSCR, strlen(CLRSCR)) != NULL;
+    /* deltas only work between normalized times, anything else is 
+	stored as is, to keep conversion lossless */
+    int sync = w->records % TTYLITE_SYNC_EVERY == 0 || clrscr ||
+	h->tv.tv_usec < 0 || h->tv.tv_usec >= 1000000 ||
+	w->prev.tv.tv_usec < 0 || w->prev.tv.tv_usec >= 1000000;
+
+    if (sync) {
+	Lite_Sync *s;
+	if (w->sync_count == w->sync_alloc) {
+	    w->sync_alloc = w->sync_alloc ? w->sync_alloc * 2 : 256;
+	    w->sync = realloc(w->sync, w->sync_alloc * sizeof(Lite_Sync));
+	    assert(w->sync != NULL);
+	}
+	s = &w->sync[w->sync_count++];
+	s->offset = ftell(w->fp);
+	s->tv_sec = h->tv.tv_sec;
+	s->tv_usec = h->tv.tv_usec;
+	s->flags = clrscr ? TTYLITE_SYNC_CLRSCR : 0;
+	put_varint(w->fp, 1);
+	put_varint(w->fp, ZIGZAG(h->tv.tv_sec));
+	put_varint(w->fp, (unsigned int) h->tv.tv_usec);
+    } else {
+	long long delta = ((long long) h->tv.tv_sec - w->prev.tv.tv_sec) * 1000000 +
+	    h->tv.tv_usec - w->prev.tv.tv_usec;
+	put_varint(w->fp, ZIGZAG(delta) << 1);
+    }
+    put_varint(w->fp, h->len);
+    w->prev = *h;
+    w->records++;
+    return fwrite(buf, 1, h->len, w->fp) == h->len;
+}
+
+int
+lite_write_end (Lite_Writer *w)
+{
+    unsigned char entry[24], trailer[TTYLITE_TRAILER];
+    long footer = ftell(w->fp);
+    int i;
+
+    for (i = 0; i < w->sync_count; i++) {
+	put_le(entry, w->sync[i].offset, 8);
+	put_le(entry + 8, w->sync[i].tv_sec, 8);
+	put_le(entry + 16, w->sync[i].tv_usec, 4);
+	put_le(entry + 20, w->sync[i].flags, 4);
+	fwrite(entry, 1, 24, w->fp);
+    }
+    put_le(trailer, footer, 8);
+    put_le(trailer + 8, w->sync_count, 4);
+    put_le(trailer + 12, 0, 4);
+    memcpy(trailer + 16, TTYLITE_END, 8);
+    free(w->sync);
+    return fwrite(trailer, 1, TTYLITE_TRAILER, w->fp) == TTYLITE_TRAILER 
+	&& !ferror(w->fp);
+}
+
 int
 read_header (FILE *fp, Header *h)
 {
     int buf[3];
+    TtyStream *st = find_stream(fp);
 
-    if (fread(buf, sizeof(int), 3, fp) == 0) {
-	return 0;
+    if (st != NULL && st->format == TTYREC_LITE) {
+	return lite_read_header(st, h);
+    }
+    if (st != NULL && st->format == TTYREC_EXT) {
+	return ext_read_header(st, h);
+    }
+
+    if (fread(buf, sizeof(int), 3, fp) != 3) {
+	return 0;	/* end of file, or a header cut short */
     }
 
     h->tv.tv_sec  = convert_to_little_endian(buf[0]);
     h->tv.tv_usec = convert_to_little_endian(buf[1]);
+    h->nsec       = 0;
     h->len        = convert_to_little_endian(buf[2]);
 
     return 1;
 }
 
+/* Last record of a file without reading through it: plain and extended
+    files are scanned backward from the end for a header whose payload 
+    ends the file, and which follows one whose payload ends just before 
+    it, both with times from first on. ttyrec-lite is read from its last
+    sync record. Returns 0 if that does not work out, and the file has
+    to be read through after all, else leaves fp at the end of the last
+    record. */
+#define PROBE_BLOCK     65536       /* first read from the end */
+#define PROBE_MAX       (16 << 20)  /* give up reading from the end */
+#define PROBE_SPAN      (100LL * 365 * 24 * 3600)  /* sec, max plausible duration */
+
+/* header at p, if plausible coming after first */
+static int
+probe_header (int format, const unsigned char *p, const Header *first, Header *h)
+{
+    if (format == TTYREC_EXT) {
+	unsigned int nsec = get_le(p + 8, 4);
+	h->tv.tv_sec = (long long) get_le(p, 8);
+	h->tv.tv_usec = nsec / 1000;
+	h->len = get_le(p + 12, 8);
+	if (nsec >= 1000000000) {
+	    return 0;
+	}
+    } else {
+	h->tv.tv_sec = (int) get_le(p, 4);
+	h->tv.tv_usec = (int) get_le(p + 4, 4);
+	h->len = (int) get_le(p + 8, 4);
+	if (h->tv.tv_usec < 0 || h->tv.tv_usec >= 1000000) {
+	    return 0;
+	}
+    }
+    return h->len >= 0 && h->tv.tv_sec >= first->tv.tv_sec && 
+	   h->tv.tv_sec - first->tv.tv_sec <= PROBE_SPAN;
+}
+
+int
+read_last_header (FILE *fp, const Header *first, Header *last)
+{
+    TtyStream *st = find_stream(fp);
+    int format = st ? st->format : TTYREC_PLAIN;
+    int hsize = format == TTYREC_EXT ? TTYEXT_RECORD : 12;
+    long start = st ? st->data_start : 0;
+    long size, from, block, p, q;
+    unsigned char *buf = NULL;
+    Header h, prev;
+
+    if (format == TTYREC_LITE) {
+	if (st->sync_count == 0) {
+	    return 0;
+	}
+	fseek(fp, st->sync[st->sync_count - 1].offset, SEEK_SET);
+	if (!read_header(fp, last)) {
+	    return 0;
+	}
+	while (fseek(fp, last->len, SEEK_CUR) == 0 && read_header(fp, &h)) {
+	    *last = h;
+	}
+	return 1;
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < start + hsize) {
+	return 0;
+    }
+    for (block = PROBE_BLOCK; block <= PROBE_MAX; block *= 4) {
+	from = size - block < start ? start : size - block;
+	buf = realloc(buf, size - from);
+	fseek(fp, from, SEEK_SET);
+	if (buf == NULL || fread(buf, 1, size - from, fp) != size - from) {
+	    break;
+	}
+	for (p = size - hsize; p >= from; p--) {
+	    if (!probe_header(format, buf + p - from, first, &h) || 
+		p + hsize + h.len != size) {
+		continue;
+	    }
+	    if (p == start) {		/* the only record */
+		*last = h;
+		free(buf);
+		return 1;
+	    }
+	    /* a header right before, which ends where this starts */
+	    for (q = p - hsize; q >= from; q--) {
+		if (probe_header(format, buf + q - from, first, &prev) &&
+		    q + hsize + prev.len == p && prev.tv.tv_sec <= h.tv.tv_sec) {
+		    *last = h;
+		    free(buf);
+		    return 1;
+		}
+	    }
+	}
+	if (from == start) {
+	    break;
+	}
+    }
+    free(buf);
+    return 0;
+}
+
+/* Position fp at the first record starting at or after pos, which may 
+    be anywhere in the file, e.g. random. In plain and extended files 
+    that is where RESYNC_CHAIN headers in a row check out with 
+    probe_header(), each where the payload of the one before ends, or
+    the chain ends the file; ttyrec-lite is read from the sync record 
+    before pos. Returns offset of the record, or -1 if none was found within 
+    RESYNC_BLOCK bytes. */
+#define RESYNC_BLOCK    65536
+#define RESYNC_CHAIN    4
+
+long
+ttyresync (FILE *fp, long pos, const Header *first)
+{
+    TtyStream *st = find_stream(fp);
+    int format = st ? st->format : TTYREC_PLAIN;
+    int hsize = format == TTYREC_EXT ? TTYEXT_RECORD : 12;
+    long start = st ? st->data_start : 0;
+    unsigned char buf[RESYNC_BLOCK], hdr[TTYEXT_RECORD];
+    long size, n, p, off;
+    Header h;
+    int i;
+
+    if (format == TTYREC_LITE) {
+	if (st->sync_count == 0) {
+	    return -1;
+	}
+	if (pos <= st->sync[0].offset) {
+	    fseek(fp, st->sync[0].offset, SEEK_SET);
+	    return st->sync[0].offset;
+	}
+	if (lite_resync(st, pos) == 0 && ftell(fp) < pos) {
+	    return -1;	/* end of records before pos */
+	}
+	off = ftell(fp);
+	if (off >= st->data_end) {
+	    return -1;
+	}
+	return off;
+    }
+
+    if (pos < start) {
+	pos = start;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0) {
+	return -1;
+    }
+    fseek(fp, pos, SEEK_SET);
+    n = fread(buf, 1, RESYNC_BLOCK, fp);
+    for (p = 0; p + hsize <= n; p++) {
+	if (!probe_header(format, buf + p, first, &h)) {
+	    continue;
+	}
+	/* follow the chain in the file, payloads may be long */
+	for (i = 1, off = pos + p + hsize + h.len; i < RESYNC_CHAIN && off < size; i++) {
+	    Header next;
+	    if (fseek(fp, off, SEEK_SET) != 0 || fread(hdr, 1, hsize, fp) != hsize ||
+		!probe_header(format, hdr, first, &next) || next.tv.tv_sec < h.tv.tv_sec) {
+		break;
+	    }
+	    h = next;
+	    off += hsize + h.len;
+	}
+	if (off == size || i == RESYNC_CHAIN) {
+	    fseek(fp, pos + p, SEEK_SET);
+	    return pos + p;
+	}
+    }
+    return -1;
+}
+
+/* Open path up to parts times, for scanning its records in parallel, 
+    fp[k] from record at from[k] up to from[k + 1], where from[parts]
+    is the end of the file. Parts start where ttyresync() finds records,
+    so the end of one has to be checked to be the start of the next. 
+    Recordings not read directly from a file, i.e. decompressed or in a 
+    pack, and small ones are not split, as streams would share state 
+    or it would not pay off. Returns count of parts, fp[0] is at the 
+    first record. */
+#define SPLIT_MIN   (16 << 20)  /* bytes, smallest part worth a thread */
+
+int
+ttysplit (const char *path, int parts, FILE **fp, long *from)
+{
+    Header first;
+    long size;
+    int k, n = 1;
+
+    fp[0] = ttyopen(path);
+    from[0] = ftell(fp[0]);
+    if (fileno(fp[0]) < 0 || fseek(fp[0], 0, SEEK_END) != 0) {
+	fseek(fp[0], from[0], SEEK_SET);
+	from[1] = LONG_MAX;	/* to the end, wherever that is */
+	return 1;
+    }
+    size = ftell(fp[0]);
+    if (parts > (size - from[0]) / SPLIT_MIN) {
+	parts = (size - from[0]) / SPLIT_MIN;
+    }
+    fseek(fp[0], from[0], SEEK_SET);
+    if (parts > 1 && read_header(fp[0], &first)) {
+	for (k = 1; k < parts; k++) {
+	    fp[n] = ttyopen(path);
+	    from[n] = ttyresync(fp[n], from[0] + (size - from[0]) / parts * k, &first);
+	    if (from[n] > from[n - 1]) {
+		n++;
+	    } else {
+		ttyclose(fp[n]);
+	    }
+	}
+    }
+    fseek(fp[0], from[0], SEEK_SET);
+    from[n] = size;
+    return n;
+}
+
 int
 write_header (FILE *fp, Header *h)
 {
     int buf[3];
 
+    if (h->len > INT_MAX || h->len < 0 ||
+	h->tv.tv_sec > INT_MAX || h->tv.tv_sec < INT_MIN) {
+	return 0;	/* does not fit plain ttyrec */
+    }
     buf[0] = convert_to_little_endian(h->tv.tv_sec);
     buf[1] = convert_to_little_endian(h->tv.tv_usec);
     buf[2] = convert_to_little_endian(h->len);
@@ -110,12 +859,6 @@ write_header (FILE *fp, Header *h)
     return 1;
 }
 
-static char *progname = "";
-void
-set_progname (const char *name)
-{
-    progname = strdup(name);
-}
 
 FILE *
 efopen (const char *path, const char *mode)
@@ -4,10 +4,33 @@
 #include "ttyrec.h"
 
 int     read_header     (FILE *fp, Header *h);
+int     read_last_header    (FILE *fp, const Header *first, Header *last);
+long    ttyresync       (FILE *fp, long pos, const Header *first);
+int     ttysplit        (const char *path, int parts, FILE **fp, long *from);
 int     write_header    (FILE *fp, Header *h);
 FILE*   efopen          (const char *path, const char *mode);
 int     edup            (int oldfd);
 int     edup2           (int oldfd, int newfd);
 FILE*   efdopen         (int fd, const char *mode);
+int     efclose         (FILE *fd);
+void*   emalloc         (size_t size);
+void    set_progname    (const char *name);
+const char* get_progname    (void);
+
+FILE*   ttyopen         (const char *path);
+FILE*   ttyreopen       (const char *path, FILE *fp);
+int     ttyclose        (FILE *fp);
+int     ttyformat       (FILE *fp);
+long    ttydataend      (FILE *fp);
+
+void    put_le          (unsigned char *p, unsigned long long x, int size);
+unsigned long long get_le   (const unsigned char *p, int size);
+int     put_varint      (FILE *fp, unsigned long long x);
+int     get_varint      (FILE *fp, unsigned long long *x);
+int     ext_write_start     (FILE *fp);
+int     ext_write_header    (FILE *fp, Header *h);
+void    lite_write_start    (Lite_Writer *w, FILE *fp);
+int     lite_write_record   (Lite_Writer *w, Header *h, const char *buf);
+int     lite_write_end      (Lite_Writer *w);
 
 #endif
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* 
+ * pack: many recordings in one file, cf. ttyrec.h
+ * 
+ * A pack is mapped into memory once and its directory read, after which
+ * opening a recording in it is a lookup and fmemopen(), with no system
+ * calls to speak of. Packs stay mapped for the rest of the run.
+ */
+
+#define _GNU_SOURCE     /* strptime() */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ttyrec.h"
+#include "io.h"
+#include "pack.h"
+
+typedef struct PACK
+{
+    char *path;
+    unsigned char *map;
+    size_t size;
+    Pack_Member *members;   /* in order of pack */
+    Pack_Member **by_name;  /* sorted by name */
+    int count;
+} Pack;
+
+/* packs mapped so far */
+static Pack **packs = NULL;
+static int pack_count = 0;
+
+static int
+member_cmp (const void *a, const void *b)
+{
+    return strcmp((*(Pack_Member **) a)->name, (*(Pack_Member **) b)->name);
+}
+
+static void
+pack_corrupt (const char *path)
+{
+    fprintf(stderr, "%s: %s: corrupt pack\n", get_progname(), path);
+    exit(EXIT_FAILURE);
+}
+
+/* map pack at path and read its directory, NULL if it is no pack */
+static Pack *
+pack_load (const char *path)
+{
+    unsigned char *p, *end;
+    struct stat st;
+    Pack *pack;
+    int fd, i, k;
+
+    for (i = 0; i < pack_count; i++) {
+	if (strcmp(packs[i]->path, path) == 0) {
+	    return packs[i];
+	}
+    }
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	return NULL;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || 
+	st.st_size < TTYPACK_HEADER + TTYPACK_TRAILER) {
+	close(fd);
+	return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+	return NULL;
+    }
+    if (memcmp(p, TTYPACK_MAGIC, 8) != 0) {
+	munmap(p, st.st_size);
+	return NULL;
+    }
+    if (p[8] != TTYPACK_VERSION) {
+	fprintf(stderr, "%s: %s: unsupported pack version\n", get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+
+    pack = emalloc(sizeof(Pack));
+    pack->path = strdup(path);
+    pack->map = p;
+    pack->size = st.st_size;
+    end = p + st.st_size - TTYPACK_TRAILER;
+    if (memcmp(end + 16, TTYPACK_END, 8) != 0 || 
+	get_le(end, 8) < TTYPACK_HEADER || get_le(end, 8) > end - p) {
+	pack_corrupt(path);
+    }
+    pack->count = get_le(end + 8, 4);
+    pack->members = emalloc((pack->count + 1) * sizeof(Pack_Member));
+    pack->by_name = emalloc((pack->count + 1) * sizeof(Pack_Member *));
+    p += get_le(end, 8);
+
+    /* each field is checked to be within the directory before reading */
+#define NEED(n) if (end - p < (n)) pack_corrupt(path)
+    for (i = 0; i < pack->count; i++) {
+	Pack_Member *m = &pack->members[i];
+	int len;
+
+	NEED(2);
+	len = get_le(p, 2);
+	NEED(2 + len + 40);
+	m->name = emalloc(len + 1);
+	memcpy(m->name, p + 2, len);
+	m->name[len] = '\0';
+	p += 2 + len;
+	m->offset = get_le(p, 8);
+	m->size = get_le(p + 8, 8);
+	m->start.tv_sec = get_le(p + 16, 8);
+	m->start.tv_usec = get_le(p + 24, 4);
+	m->duration = get_le(p + 28, 8);
+	m->key_count = get_le(p + 36, 4);
+	p += 40;
+	if (m->offset < TTYPACK_HEADER || m->size < 0 || m->key_count < 0 ||
+	    m->offset + m->size > pack->size) {
+	    pack_corrupt(path);
+	}
+	NEED(16LL * m->key_count);
+	m->keys = emalloc((m->key_count + 1) * sizeof(Pack_Key));
+	for (k = 0; k < m->key_count; k++, p += 16) {
+	    m->keys[k].offset = get_le(p, 8);
+	    m->keys[k].time = get_le(p + 8, 8);
+	}
+	pack->by_name[i] = m;
+    }
+#undef NEED
+    qsort(pack->by_name, pack->count, sizeof(Pack_Member *), member_cmp);
+
+    packs = realloc(packs, (pack_count + 1) * sizeof(Pack *));
+    if (packs == NULL) {
+	perror("realloc");
+	exit(EXIT_FAILURE);
+    }
+    packs[pack_count++] = pack;
+    return pack;
+}
+
+/* if path is PACK:NAME or PACK@TIME, set *pack and return the separator 
+    in path, else NULL. A file called path itself always wins. */
+static const char *
+pack_split (const char *path, Pack **pack)
+{
+    const char *sep;
+    int i;
+
+    if (strchr(path, TTYPACK_BY_NAME) == NULL && strchr(path, TTYPACK_BY_TIME) == NULL) {
+	return NULL;
+    }
+    /* packs already mapped cost nothing to check */
+    for (i = 0; i < pack_count; i++) {
+	size_t len = strlen(packs[i]->path);
+	if (strncmp(path, packs[i]->path, len) == 0 &&
+	    (path[len] == TTYPACK_BY_NAME || path[len] == TTYPACK_BY_TIME)) {
+	    *pack = packs[i];
+	    return path + len;
+	}
+    }
+    if (access(path, F_OK) == 0) {
+	return NULL;
+    }
+    for (sep = path + strlen(path) - 1; sep > path; sep--) {
+	if (*sep == TTYPACK_BY_NAME || *sep == TTYPACK_BY_TIME) {
+	    char *prefix = strndup(path, sep - path);
+	    *pack = pack_load(prefix);
+	    free(prefix);
+	    if (*pack != NULL) {
+		return sep;
+	    }
+	}
+    }
+    return NULL;
+}
+
+/* seconds since epoch, or local time as YYYY-MM-DDTHH:MM:SS */
+static int
+parse_time (const char *s, struct timeval *tv)
+{
+    struct tm tm;
+    char *end;
+    double t = strtod(s, &end);
+
+    if (end != s && *end == '\0') {
+	tv->tv_sec = t;
+	tv->tv_usec = (t - tv->tv_sec) * 1000000;
+	return 1;
+    }
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (end == NULL || *end != '\0') {
+	return 0;
+    }
+    tm.tm_isdst = -1;
+    tv->tv_sec = mktime(&tm);
+    tv->tv_usec = 0;
+    return 1;
+}
+
+static long long
+usec (struct timeval tv)
+{
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* recording running at t, or else the first to start after it, and 
+    in *start the offset of the last keyframe at or before t */
+static Pack_Member *
+member_at (Pack *pack, struct timeval tv, long *start)
+{
+    Pack_Member *best = NULL;
+    long long t = usec(tv);
+    int i;
+
+    *start = 0;
+    for (i = 0; i < pack->count; i++) {
+	Pack_Member *m = &pack->members[i];
+	long long s = usec(m->start);
+	if (s <= t && t <= s + m->duration) {
+	    best = m;
+	    break;
+	}
+	if (s > t && (best == NULL || s < usec(best->start))) {
+	    best = m;
+	}
+    }
+    if (best != NULL && usec(best->start) <= t) {
+	for (i = 0; i < best->key_count && 
+	     usec(best->start) + best->keys[i].time <= t; i++) {
+	    *start = best->keys[i].offset;
+	}
+    }
+    return best;
+}
+
+/* open recording path in a pack, reading from *start. NULL if path is 
+    not in a pack. */
+FILE *
+pack_open (const char *path, long *start)
+{
+    Pack *pack;
+    Pack_Member key, *kp = &key, **found, *m;
+    const char *sep = pack_split(path, &pack);
+    struct timeval tv;
+    FILE *fp;
+
+    *start = 0;
+    if (sep == NULL) {
+	return NULL;
+    }
+    if (*sep == TTYPACK_BY_NAME) {
+	key.name = (char *) sep + 1;
+	found = bsearch(&kp, pack->by_name, pack->count, sizeof(Pack_Member *), 
+			member_cmp);
+	m = found ? *found : NULL;
+    } else if (parse_time(sep + 1, &tv)) {
+	m = member_at(pack, tv, start);
+    } else {
+	fprintf(stderr, "%s: %s: bad time, use seconds since epoch or "
+		"YYYY-MM-DDTHH:MM:SS\n", get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    if (m == NULL) {
+	fprintf(stderr, "%s: %s: not in pack\n", get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    fp = fmemopen(pack->map + m->offset, m->size, "r");
+    if (fp == NULL) {
+	fprintf(stderr, "%s: %s: %s\n", get_progname(), path, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+/* recordings in pack at path, in pack order, or -1 if it is no pack */
+int
+pack_members (const char *path, Pack_Member **members)
+{
+    Pack *pack = pack_load(path);
+
+    if (pack == NULL) {
+	return -1;
+    }
+    *members = pack->members;
+    return pack->count;
+}
+
+/* copy of argv with arguments from first on that name packs replaced
+    by PACK:NAME of each recording in them, returns new argc */
+int
+pack_expand_args (int argc, char **argv, int first, char ***out)
+{
+    char **args = emalloc((argc + 1) * sizeof(char *));
+    int i, k, n = 0, alloc = argc + 1;
+
+    for (i = 0; i < argc; i++) {
+	size_t len = strlen(argv[i]), slen = strlen(TTYPACK_SUFFIX);
+	Pack_Member *m;
+	int count;
+
+	if (i < first || len < slen || 
+	    strcmp(argv[i] + len - slen, TTYPACK_SUFFIX) != 0 ||
+	    (count = pack_members(argv[i], &m)) < 0) {
+	    args[n++] = argv[i];
+	    continue;
+	}
+	if (n + count + argc - i > alloc) {
+	    alloc = n + count + argc - i;
+	    args = realloc(args, alloc * sizeof(char *));
+	    if (args == NULL) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	    }
+	}
+	for (k = 0; k < count; k++) {
+	    args[n] = emalloc(len + strlen(m[k].name) + 2);
+	    sprintf(args[n++], "%s%c%s", argv[i], TTYPACK_BY_NAME, m[k].name);
+	}
+    }
+    args[n] = NULL;
+    *out = args;
+    return n;
+}
+
+/* Writing a pack: pack_write_start(), pack_write_member() for each 
+    recording, after which the caller fills in the rest of the member, and
+    pack_write_end() to add the directory. */
+int
+pack_write_start (FILE *fp)
+{
+    unsigned char hdr[TTYPACK_HEADER];
+
+    memset(hdr, 0, TTYPACK_HEADER);
+    memcpy(hdr, TTYPACK_MAGIC, 8);
+    hdr[8] = TTYPACK_VERSION;
+    return fwrite(hdr, 1, TTYPACK_HEADER, fp) == TTYPACK_HEADER;
+}
+
+/* copy all of in to fp, setting offset and size of m */
+int
+pack_write_member (FILE *fp, Pack_Member *m, FILE *in)
+{
+    char buf[BUFSIZ];
+    size_t n;
+
+    m->offset = ftell(fp);
+    m->size = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+	if (fwrite(buf, 1, n, fp) != n) {
+	    return 0;
+	}
+	m->size += n;
+    }
+    return !ferror(in);
+}
+
+int
+pack_write_end (FILE *fp, Pack_Member *members, int count)
+{
+    unsigned char buf[40];
+    long long dir = ftell(fp);
+    int i, k;
+
+    for (i = 0; i < count; i++) {
+	Pack_Member *m = &members[i];
+	size_t len = strlen(m->name);
+
+	put_le(buf, len, 2);
+	if (fwrite(buf, 1, 2, fp) != 2 || fwrite(m->name, 1, len, fp) != len) {
+	    return 0;
+	}
+	put_le(buf, m->offset, 8);
+	put_le(buf + 8, m->size, 8);
+	put_le(buf + 16, m->start.tv_sec, 8);
+	put_le(buf + 24, m->start.tv_usec, 4);
+	put_le(buf + 28, m->duration, 8);
+	put_le(buf + 36, m->key_count, 4);
+	if (fwrite(buf, 1, 40, fp) != 40) {
+	    return 0;
+	}
+	for (k = 0; k < m->key_count; k++) {
+	    put_le(buf, m->keys[k].offset, 8);
+	    put_le(buf + 8, m->keys[k].time, 8);
+	    if (fwrite(buf, 1, 16, fp) != 16) {
+		return 0;
+	    }
+	}
+    }
+    put_le(buf, dir, 8);
+    put_le(buf + 8, count, 4);
+    put_le(buf + 12, 0, 4);
+    memcpy(buf + 16, TTYPACK_END, 8);
+    return fwrite(buf, 1, TTYPACK_TRAILER, fp) == TTYPACK_TRAILER;
+}
@@ -0,0 +1,14 @@
+#ifndef __TTYREC_PACK_H__
+#define __TTYREC_PACK_H__
+
+#include <stdio.h>
+#include "ttyrec.h"
+
+FILE*   pack_open       (const char *path, long *start);
+int     pack_members    (const char *path, Pack_Member **members);
+int     pack_expand_args    (int argc, char **argv, int first, char ***out);
+int     pack_write_start    (FILE *fp);
+int     pack_write_member   (FILE *fp, Pack_Member *m, FILE *in);
+int     pack_write_end      (FILE *fp, Pack_Member *members, int count);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttyconv
+ * 
+ * converts ttyrec files between plain ttyrec, ttyrec-lite and the
+ * extended precision variant
+ * 
+ * usage: ttyconv [-l | -p | -x] infile outfile
+ * 
+ * input may be in any format, output is ttyrec-lite (-l, default), 
+ * plain ttyrec (-p) or extended (-x). Only -x keeps nanoseconds and
+ * records whose length or time does not fit plain ttyrec; a warning is
+ * printed if anything is lost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "io.h"
+#include "ttyrec.h"
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s [-l | -p | -x] infile outfile\n", basename(pgmname));
+    printf("  -l  write ttyrec-lite (default)\n");
+    printf("  -p  write plain ttyrec\n");
+    printf("  -x  write extended precision ttyrec\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    int format = TTYREC_LITE;
+    long long records = 0, lost_nsec = 0;
+    Lite_Writer writer;
+    FILE *in, *out;
+    Header h;
+    char *buf = NULL;
+    long long bufsize = 0;
+    int ok;
+    int ch;
+
+    set_progname(argv[0]);
+    while ((ch = getopt(argc, argv, "lpx")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'l':
+            format = TTYREC_LITE;
+            break;
+        case 'p':
+            format = TTYREC_PLAIN;
+            break;
+        case 'x':
+            format = TTYREC_EXT;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+
+    in = ttyopen(argv[optind]);
+    out = efopen(argv[optind + 1], "w");
+    if (format == TTYREC_LITE)
+        lite_write_start(&writer, out);
+    else if (format == TTYREC_EXT && ext_write_start(out) == 0)
+    {
+        perror(argv[optind + 1]);
+        exit(EXIT_FAILURE);
+    }
+
+    while (read_header(in, &h))
+    {
+        if (h.len < 0)
+        {
+            fprintf(stderr, "%s: record #%lld of negative length, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (h.len > bufsize)
+        {
+            bufsize = h.len;
+            buf = realloc(buf, bufsize);
+            if (buf == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fread(buf, 1, h.len, in) != h.len)
+        {
+            fprintf(stderr, "%s: truncated record #%lld, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (format == TTYREC_PLAIN && write_header(out, &h) == 0 && !ferror(out))
+        {
+            fprintf(stderr, "%s: record #%lld does not fit plain ttyrec, "
+                    "use -x\n", argv[optind], records + 1);
+            exit(EXIT_FAILURE);
+        }
+        switch (format)
+        {
+        case TTYREC_LITE:
+            ok = lite_write_record(&writer, &h, buf);
+            break;
+        case TTYREC_EXT:
+            ok = ext_write_header(out, &h) && fwrite(buf, 1, h.len, out) == h.len;
+            break;
+        default:
+            ok = !ferror(out) && fwrite(buf, 1, h.len, out) == h.len;
+        }
+        if (!ok)
+        {
+            perror(argv[optind + 1]);
+            exit(EXIT_FAILURE);
+        }
+        if (h.nsec && format != TTYREC_EXT)
+            lost_nsec++;
+        records++;
+    }
+    if (format == TTYREC_LITE && !lite_write_end(&writer))
+    {
+        perror(argv[optind + 1]);
+        exit(EXIT_FAILURE);
+    }
+    if (lost_nsec)
+        fprintf(stderr, "%s: sub-microsecond time of %lld record(s) was "
+                "truncated, use -x to keep it\n", argv[optind], lost_nsec);
+
+    ttyclose(in);
+    efclose(out);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,621 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttydedup
+ * 
+ * finds recordings that are copies of each other, under whatever names
+ * 
+ * usage: ttydedup [-l] [-j threads] file [file]...
+ * 
+ * Files are compared by size first, then by a hash of a few blocks
+ * spread over them, and only those still alike are hashed in full.
+ * Groups of copies are printed one file a line, the one kept first,
+ * with a blank line between groups. With -l, each copy is replaced by
+ * a hard link to the file kept, which is the one given first. Files
+ * that do not start with a record are not recordings and are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "io.h"
+#include "ttyrec.h"
+
+#define MAX_THREADS    64
+#define SAMPLE_BLOCKS  4        /* blocks hashed of each file at first */
+#define SAMPLE_BLOCK   4096
+#define READ_BUFFER    (1024 * 1024)
+#define LINK_SUFFIX    ".ttydedup"    /* and .pid.n of a name not taken */
+#define LINK_TRIES     100
+
+/* 64 bit hash of four lanes taking 8 bytes each at a time, as xxHash64
+    does; the lanes do not depend on each other, so the compiler keeps
+    them all in flight at once */
+#define PRIME1  0x9E3779B185EBCA87ULL
+#define PRIME2  0xC2B2AE3D27D4EB4FULL
+#define PRIME3  0x165667B19E3779F9ULL
+#define PRIME4  0x85EBCA77C2B2AE63ULL
+#define PRIME5  0x27D4EB2F165667C5ULL
+
+#define ROTL(x, r)  (((x) << (r)) | ((x) >> (64 - (r))))
+
+typedef struct {
+    unsigned long long lane[4];
+    unsigned long long total;
+    unsigned char buf[32];      /* bytes short of a stripe */
+    int fill;
+} Hash;
+
+typedef struct {
+    const char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    unsigned long long sample, full;
+    int index;                  /* in order of arguments */
+    int hashed;                 /* full is known, and it is a recording */
+    int skipped;                /* not a recording, or not read */
+    int keep;                   /* index of file it is a copy of, or -1 */
+} Entry;
+
+/* files for the threads to take one at a time */
+typedef struct {
+    pthread_mutex_t lock;
+    Entry **todo;
+    int count, next;
+    int full;                   /* hash in full, else sample */
+} Job;
+
+static int threads;
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s [-l] [-j threads] file [file]...\n", basename(pgmname));
+    printf("  -l  replace copies by hard links to the first of them\n");
+    printf("  -j  files to read at once, default as many as processors\n");
+    exit(EXIT_FAILURE);
+}
+
+static unsigned long long
+load64 (const unsigned char *p)
+{
+    unsigned long long x;
+
+    memcpy(&x, p, 8);
+    return x;
+}
+
+static unsigned long long
+round64 (unsigned long long acc, unsigned long long x)
+{
+    acc += x * PRIME2;
+    acc = ROTL(acc, 31);
+    return acc * PRIME1;
+}
+
+static void
+hash_init (Hash *h)
+{
+    h->lane[0] = PRIME1 + PRIME2;
+    h->lane[1] = PRIME2;
+    h->lane[2] = 0;
+    h->lane[3] = -PRIME1;
+    h->total = 0;
+    h->fill = 0;
+}
+
+static void
+hash_update (Hash *h, const unsigned char *p, size_t len)
+{
+    unsigned long long v0, v1, v2, v3;
+
+    h->total += len;
+    if (h->fill > 0)
+    {
+        size_t n = 32 - h->fill < len ? 32 - h->fill : len;
+
+        memcpy(h->buf + h->fill, p, n);
+        h->fill += n;
+        p += n;
+        len -= n;
+        if (h->fill < 32)
+            return;
+        h->lane[0] = round64(h->lane[0], load64(h->buf));
+        h->lane[1] = round64(h->lane[1], load64(h->buf + 8));
+        h->lane[2] = round64(h->lane[2], load64(h->buf + 16));
+        h->lane[3] = round64(h->lane[3], load64(h->buf + 24));
+        h->fill = 0;
+    }
+    v0 = h->lane[0];
+    v1 = h->lane[1];
+    v2 = h->lane[2];
+    v3 = h->lane[3];
+    for (; len >= 32; p += 32, len -= 32)
+    {
+        v0 = round64(v0, load64(p));
+        v1 = round64(v1, load64(p + 8));
+        v2 = round64(v2, load64(p + 16));
+        v3 = round64(v3, load64(p + 24));
+    }
+    h->lane[0] = v0;
+    h->lane[1] = v1;
+    h->lane[2] = v2;
+    h->lane[3] = v3;
+    memcpy(h->buf, p, len);
+    h->fill = len;
+}
+
+static unsigned long long
+merge64 (unsigned long long acc, unsigned long long lane)
+{
+    acc ^= round64(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+static unsigned long long
+hash_final (Hash *h)
+{
+    unsigned long long acc;
+    const unsigned char *p = h->buf;
+    int i, len = h->fill;
+
+    acc = ROTL(h->lane[0], 1) + ROTL(h->lane[1], 7)
+        + ROTL(h->lane[2], 12) + ROTL(h->lane[3], 18);
+    for (i = 0; i < 4; i++)
+        acc = merge64(acc, h->lane[i]);
+    acc += h->total;
+    for (; len >= 8; p += 8, len -= 8)
+        acc = ROTL(acc ^ round64(0, load64(p)), 27) * PRIME1 + PRIME4;
+    for (; len > 0; p++, len--)
+        acc = ROTL(acc ^ (*p * PRIME5), 11) * PRIME1;
+    acc ^= acc >> 33;
+    acc *= PRIME2;
+    acc ^= acc >> 29;
+    acc *= PRIME3;
+    return acc ^ (acc >> 32);
+}
+
+/* a file is taken for a recording if its first record fits in it; plain
+    ttyrec has no magic to tell it by. The reader of io.c knows the rest
+    of the formats, compressed ones included. */
+static int
+is_recording (const Entry *e)
+{
+    FILE *fp;
+    Header h;
+    int ok;
+
+    if (access(e->path, R_OK) != 0)
+        return 0;
+    fp = ttyopen(e->path);
+    ok = read_header(fp, &h) && h.tv.tv_usec >= 0 && h.tv.tv_usec < 1000000
+        && (ttyformat(fp) != TTYREC_PLAIN || fileno(fp) < 0
+            || (long long) h.len <= (long long) e->size - 12);
+    ttyclose(fp);
+    return ok;
+}
+
+/* hash of e read at its offsets, in full or SAMPLE_BLOCKS blocks from
+    first to last; 0 if it cannot be read */
+static int
+hash_file (Entry *e, int full, unsigned char *buf)
+{
+    Hash h;
+    off_t pos = 0, step;
+    ssize_t n;
+    int fd = open(e->path, O_RDONLY), k;
+
+    if (fd < 0)
+        return 0;
+    hash_init(&h);
+    if (full)
+    {
+        while ((n = read(fd, buf, READ_BUFFER)) > 0)
+        {
+            hash_update(&h, buf, n);
+            pos += n;
+        }
+    }
+    else
+    {
+        step = (e->size - SAMPLE_BLOCK) / (SAMPLE_BLOCKS - 1);
+        for (k = 0, n = 0; k < SAMPLE_BLOCKS; k++)
+        {
+            n = pread(fd, buf, SAMPLE_BLOCK, k * step);
+            if (n != SAMPLE_BLOCK)
+                break;
+            hash_update(&h, buf, n);
+            pos += n;
+        }
+    }
+    close(fd);
+    if (n < 0 || pos != (full ? e->size : SAMPLE_BLOCKS * SAMPLE_BLOCK))
+        return 0;
+    if (full)
+        e->full = hash_final(&h);
+    else
+        e->sample = hash_final(&h);
+    return 1;
+}
+
+/* take files of job one at a time until there are none left. Files 
+    small enough that a sample would be most of them are hashed in full
+    right away, and so are checked to be recordings then. */
+static void *
+hash_worker (void *arg)
+{
+    Job *job = arg;
+    unsigned char *buf = emalloc(READ_BUFFER);
+    Entry *e;
+    int i, full;
+
+    while (1)
+    {
+        pthread_mutex_lock(&job->lock);
+        i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->count)
+            break;
+        e = job->todo[i];
+        full = job->full || e->size <= SAMPLE_BLOCKS * SAMPLE_BLOCK;
+        if (full && !is_recording(e))
+        {
+            fprintf(stderr, "%s: %s: not a recording, skipped\n", get_progname(), e->path);
+            e->skipped = 1;
+            continue;
+        }
+        errno = 0;
+        if (!hash_file(e, full, buf))
+        {
+            fprintf(stderr, "%s: %s: %s, skipped\n", get_progname(), e->path,
+                    errno ? strerror(errno) : "changed while read");
+            e->skipped = 1;
+            continue;
+        }
+        if (full)
+        {
+            e->sample = e->full;
+            e->hashed = 1;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+/* hash count files of todo, by up to as many threads at once as asked
+    for */
+static void
+hash_files (Entry **todo, int count, int full)
+{
+    pthread_t thread[MAX_THREADS];
+    Job job;
+    int k, n = count < threads ? count : threads;
+
+    job.todo = todo;
+    job.count = count;
+    job.next = 0;
+    job.full = full;
+    pthread_mutex_init(&job.lock, NULL);
+    for (k = 1; k < n; k++)
+    {
+        if (pthread_create(&thread[k], NULL, hash_worker, &job) != 0)
+        {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    hash_worker(&job);
+    for (k = 1; k < n; k++)
+        pthread_join(thread[k], NULL);
+    pthread_mutex_destroy(&job.lock);
+}
+
+static int
+inode_cmp (const void *a, const void *b)
+{
+    const Entry *x = *(Entry * const *) a, *y = *(Entry * const *) b;
+
+    if (x->dev != y->dev)
+        return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino)
+        return x->ino < y->ino ? -1 : 1;
+    return x->index - y->index;
+}
+
+/* by size, then sample hash, then full hash, then order given */
+static int
+hash_cmp (const void *a, const void *b)
+{
+    const Entry *x = *(Entry * const *) a, *y = *(Entry * const *) b;
+
+    if (x->size != y->size)
+        return x->size < y->size ? -1 : 1;
+    if (x->sample != y->sample)
+        return x->sample < y->sample ? -1 : 1;
+    if (x->full != y->full)
+        return x->full < y->full ? -1 : 1;
+    return x->index - y->index;
+}
+
+static int
+keep_cmp (const void *a, const void *b)
+{
+    const Entry *x = *(Entry * const *) a, *y = *(Entry * const *) b;
+
+    if (x->keep != y->keep)
+        return x->keep - y->keep;
+    return x->index - y->index;
+}
+
+/* keeps only entries of list alike to another one by same(), returns
+    how many are left */
+static int
+alike (Entry **list, int count, int (*same)(const Entry *, const Entry *))
+{
+    int i, j, n = 0;
+
+    for (i = 0; i < count; i = j)
+    {
+        for (j = i + 1; j < count && same(list[i], list[j]); j++)
+            ;
+        if (j - i > 1)
+        {
+            memmove(list + n, list + i, (j - i) * sizeof(Entry *));
+            n += j - i;
+        }
+    }
+    return n;
+}
+
+static int
+same_size (const Entry *x, const Entry *y)
+{
+    return x->size == y->size;
+}
+
+static int
+same_sample (const Entry *x, const Entry *y)
+{
+    return x->size == y->size && x->sample == y->sample;
+}
+
+static int
+same_full (const Entry *x, const Entry *y)
+{
+    return x->size == y->size && x->full == y->full;
+}
+
+/* 1 if the files at a and b have the same bytes */
+static int
+same_bytes (const char *a, const char *b)
+{
+    FILE *fa = efopen(a, "r"), *fb = efopen(b, "r");
+    char *ba = emalloc(READ_BUFFER), *bb = emalloc(READ_BUFFER);
+    size_t na, nb;
+    int same = 1;
+
+    do {
+        na = fread(ba, 1, READ_BUFFER, fa);
+        nb = fread(bb, 1, READ_BUFFER, fb);
+        if (na != nb || memcmp(ba, bb, na) != 0)
+            same = 0;
+    } while (same && na > 0);
+    if (ferror(fa) || ferror(fb))
+        same = 0;
+    efclose(fa);
+    efclose(fb);
+    free(ba);
+    free(bb);
+    return same;
+}
+
+/* replace dup by a hard link to keep, through a temporary name so dup 
+    is never missing. A file already there by that name is left alone,
+    and the next name tried. Returns 1 if linked. */
+static int
+link_copy (const Entry *keep, const Entry *dup)
+{
+    char *tmp;
+    int k, linked = 0;
+
+    if (keep->dev != dup->dev)
+    {
+        fprintf(stderr, "%s: %s: not on the same file system as %s, not linked\n",
+                get_progname(), dup->path, keep->path);
+        return 0;
+    }
+    if (!same_bytes(keep->path, dup->path))
+    {
+        fprintf(stderr, "%s: %s: differs from %s after all, not linked\n",
+                get_progname(), dup->path, keep->path);
+        return 0;
+    }
+    tmp = emalloc(strlen(dup->path) + strlen(LINK_SUFFIX) + 32);
+    for (k = 0; k < LINK_TRIES && !linked; k++)
+    {
+        sprintf(tmp, "%s%s.%ld.%d", dup->path, LINK_SUFFIX, (long)getpid(), k);
+        linked = link(keep->path, tmp) == 0;
+        if (!linked && errno != EEXIST)
+            break;
+    }
+    if (!linked || rename(tmp, dup->path) != 0)
+    {
+        fprintf(stderr, "%s: %s: %s, not linked\n", get_progname(), dup->path, strerror(errno));
+        if (linked)
+            unlink(tmp);
+        free(tmp);
+        return 0;
+    }
+    free(tmp);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    Entry *entry, **list;
+    struct stat st;
+    int ch, i, j, n, files, count = 0, do_link = 0, copies = 0, failed = 0;
+    long long bytes = 0;
+
+    set_progname(argv[0]);
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((ch = getopt(argc, argv, "j:l")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'j':
+            threads = atoi(optarg);
+            if (threads < 1)
+                usage(argv[0]);
+            break;
+        case 'l':
+            do_link = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    n = argc - optind;
+    entry = emalloc(n * sizeof(Entry));
+    list = emalloc(n * sizeof(Entry *));
+    for (i = 0; i < n; i++)
+    {
+        Entry *e = &entry[count];
+
+        if (stat(argv[optind + i], &st) != 0)
+        {
+            perror(argv[optind + i]);
+            failed = 1;
+            continue;
+        }
+        if (!S_ISREG(st.st_mode))
+        {
+            fprintf(stderr, "%s: %s: not a regular file, skipped\n", get_progname(), argv[optind + i]);
+            continue;
+        }
+        memset(e, 0, sizeof(Entry));
+        e->path = argv[optind + i];
+        e->dev = st.st_dev;
+        e->ino = st.st_ino;
+        e->size = st.st_size;
+        e->index = count;
+        e->keep = -1;
+        list[count] = e;
+        count++;
+    }
+
+    /* names of one file, linked already, are not copies of it */
+    qsort(list, count, sizeof(Entry *), inode_cmp);
+    files = count;
+    for (i = 1, j = count ? 1 : 0; i < count; i++)
+    {
+        if (list[i]->dev != list[j - 1]->dev || list[i]->ino != list[j - 1]->ino)
+            list[j++] = list[i];
+    }
+    count = j;
+
+    /* only files of the same size can be copies, and then only those
+        of the same blocks sampled */
+    qsort(list, count, sizeof(Entry *), hash_cmp);
+    count = alike(list, count, same_size);
+    hash_files(list, count, 0);
+    for (i = j = 0; i < count; i++)
+    {
+        if (!list[i]->skipped)
+            list[j++] = list[i];
+    }
+    qsort(list, j, sizeof(Entry *), hash_cmp);
+    count = alike(list, j, same_sample);
+
+    /* those alike so far are read through, and checked to be recordings */
+    for (i = j = 0; i < count; i++)
+    {
+        if (!list[i]->hashed)
+            list[j++] = list[i];
+    }
+    hash_files(list, j, 1);
+    for (i = j = 0; i < files; i++)
+    {
+        if (entry[i].hashed)
+            list[j++] = &entry[i];
+    }
+    qsort(list, j, sizeof(Entry *), hash_cmp);
+    count = alike(list, j, same_full);
+    for (i = 0; i < count; i++)
+    {
+        list[i]->keep = i > 0 && same_full(list[i - 1], list[i])
+            ? list[i - 1]->keep : list[i]->index;
+    }
+
+    /* groups in order of the file kept, first given */
+    qsort(list, count, sizeof(Entry *), keep_cmp);
+    for (i = 0; i < count; i++)
+    {
+        Entry *e = list[i];
+
+        if (e->keep == e->index)
+        {
+            printf("%s%s\n", i > 0 ? "\n" : "", e->path);
+            continue;
+        }
+        if (do_link && !link_copy(&entry[e->keep], e))
+        {
+            failed = 1;
+            continue;
+        }
+        printf("%s\n", e->path);
+        copies++;
+        bytes += e->size;
+    }
+    fprintf(stderr, "%s: %d cop%s, %lld bytes%s\n", get_progname(), copies,
+            copies == 1 ? "y" : "ies", bytes, do_link ? " freed" : "");
+    free(list);
+    free(entry);
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttydict
+ * 
+ * trains a compression dictionary shared by a bunch of similar ttyrec
+ * files, and compresses them with it
+ * 
+ * usage: ttydict -t dictfile [-s sample] [-z size] file [file]...
+ *        ttydict -c dictfile file [file]...
+ *        ttydict -x file.ttyz [file.ttyz]...
+ * 
+ * -t samples payload of the files, up to sample bytes in all, from only
+ * some of them if there are too many for 4 KB each, and keeps
+ * the strings most of them share. -c writes file.ttyz of each file, 
+ * which ttyplay2 and ttytime2 read as they would the original, as long
+ * as the dictionary is kept next to it or in a directory listed in 
+ * TTYDICT_PATH. -x restores the original.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "io.h"
+#include "zio.h"
+#include "ttyrec.h"
+
+#define ZSUFFIX         ".ttyz"
+#define SAMPLE_SIZE     (8 << 20)   /* default bytes of payload to sample */
+#define SAMPLE_MIN      4096        /* sample at least this much a file */
+#define TRAIN_KMER      8           /* strings counted are this long */
+#define TRAIN_SEGMENT   64          /* dictionary is made of these */
+#define TRAIN_STEP      8           /* segments considered start this apart */
+#define TRAIN_HASH_BITS 22
+
+typedef struct SEGMENT
+{
+    long pos;               /* in sample */
+    unsigned int score;
+} Segment;
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s -t dictfile [-s sample] [-z size] file [file]...\n", 
+           basename(pgmname));
+    printf("       %s -c dictfile file [file]...\n", basename(pgmname));
+    printf("       %s -x file%s [file%s]...\n", basename(pgmname), ZSUFFIX, ZSUFFIX);
+    printf("  -t  train dictionary from files\n");
+    printf("  -s  bytes of payload to sample, default %d\n", SAMPLE_SIZE);
+    printf("  -z  size of dictionary, default and max %d\n", TTYDICT_MAX);
+    printf("  -c  compress files with dictionary to file%s\n", ZSUFFIX);
+    printf("  -x  expand file%s back to file\n", ZSUFFIX);
+    exit(EXIT_FAILURE);
+}
+
+static unsigned int
+kmer_hash (const unsigned char *p)
+{
+    unsigned long long x;
+
+    memcpy(&x, p, TRAIN_KMER);
+    return (x * 0x9e3779b97f4a7c15ULL) >> (64 - TRAIN_HASH_BITS);
+}
+
+/* sum of counts of k-mers in segment at p, those in one file only 
+    do not count */
+static unsigned int
+segment_score (const unsigned char *p, const unsigned int *counts)
+{
+    unsigned int score = 0;
+    int i;
+
+    for (i = 0; i <= TRAIN_SEGMENT - TRAIN_KMER; i++) {
+        unsigned int c = counts[kmer_hash(p + i)];
+        if (c > 1)
+            score += c;
+    }
+    return score;
+}
+
+static int
+segment_cmp (const void *a, const void *b)
+{
+    const Segment *x = a, *y = b;
+
+    return x->score < y->score ? 1 : x->score > y->score ? -1 : 
+           x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/* Pick segments of sample with k-mers found in most files, best first,
+    dropping those mostly covered by segments already picked. Fills dict
+    from the end, so the best are nearest to the data. Returns bytes of 
+    dict used, at its end. */
+static int
+train (const unsigned char *sample, const long *file_end, int files, 
+       unsigned char *dict, int dict_size)
+{
+    unsigned int *counts = emalloc(sizeof(unsigned int) << TRAIN_HASH_BITS);
+    unsigned int *seen = emalloc(sizeof(unsigned int) << TRAIN_HASH_BITS);
+    Segment *segs;
+    long pos, seg_count = 0, i;
+    int f, used = 0;
+
+    /* in how many files each k-mer is */
+    memset(counts, 0, sizeof(unsigned int) << TRAIN_HASH_BITS);
+    memset(seen, 0, sizeof(unsigned int) << TRAIN_HASH_BITS);
+    for (f = 0, pos = 0; f < files; pos = file_end[f++]) {
+        for (; pos + TRAIN_KMER <= file_end[f]; pos++) {
+            unsigned int h = kmer_hash(sample + pos);
+            if (seen[h] != f + 1) {
+                seen[h] = f + 1;
+                counts[h]++;
+            }
+        }
+    }
+    free(seen);
+
+    segs = emalloc((file_end[files - 1] / TRAIN_STEP + 1) * sizeof(Segment));
+    for (f = 0, pos = 0; f < files; pos = file_end[f++]) {
+        for (; pos + TRAIN_SEGMENT <= file_end[f]; pos += TRAIN_STEP) {
+            segs[seg_count].pos = pos;
+            segs[seg_count].score = segment_score(sample + pos, counts);
+            if (segs[seg_count].score)
+                seg_count++;
+        }
+    }
+    qsort(segs, seg_count, sizeof(Segment), segment_cmp);
+
+    for (i = 0; i < seg_count && used + TRAIN_SEGMENT <= dict_size; i++) {
+        const unsigned char *p = sample + segs[i].pos;
+        int k;
+
+        if (segment_score(p, counts) * 2 < segs[i].score)
+            continue;
+        used += TRAIN_SEGMENT;
+        memcpy(dict + dict_size - used, p, TRAIN_SEGMENT);
+        for (k = 0; k <= TRAIN_SEGMENT - TRAIN_KMER; k++)
+            counts[kmer_hash(p + k)] = 0;
+    }
+    free(segs);
+    free(counts);
+    return used;
+}
+
+/* train on files of names, a share of sample_size bytes of payload from
+    each, or if that would be under SAMPLE_MIN, from as many of them as 
+    get SAMPLE_MIN each, spread evenly over the list */
+static int
+train_main (const char *dictfile, long sample_size, int dict_size, 
+            int files, char **names)
+{
+    int picked = files, f, used;
+    long per_file, total = 0;
+    long *file_end;
+    unsigned char *sample = emalloc(sample_size);
+    unsigned char dict[TTYDICT_MAX];
+
+    if (sample_size / files < SAMPLE_MIN) {
+        picked = sample_size / SAMPLE_MIN;
+        if (picked < 1)
+            picked = 1;
+    }
+    per_file = sample_size / picked;
+    file_end = emalloc(picked * sizeof(long));
+    for (f = 0; f < picked; f++) {
+        FILE *fp = ttyopen(names[(long long) f * files / picked]);
+        long end = total + per_file;
+        Header h;
+
+        while (total < end && read_header(fp, &h) && h.len >= 0) {
+            long n = h.len < end - total ? h.len : end - total;
+            if (fread(sample + total, 1, n, fp) != n)
+                break;
+            total += n;
+            fseek(fp, h.len - n, SEEK_CUR);
+        }
+        file_end[f] = total;
+        ttyclose(fp);
+    }
+
+    used = train(sample, file_end, picked, dict, dict_size);
+    if (used == 0) {
+        fprintf(stderr, "%s: nothing shared by the files, no dictionary written\n", 
+                get_progname());
+        return EXIT_FAILURE;
+    }
+    if (!dict_save(dictfile, dict + dict_size - used, used)) {
+        perror(dictfile);
+        return EXIT_FAILURE;
+    }
+    printf("%s: %d bytes from %ld bytes of %d of %d file(s)\n", dictfile, used, total, 
+           picked, files);
+    free(sample);
+    free(file_end);
+    return 0;
+}
+
+/* whole file into memory */
+static char *
+slurp (FILE *fp, long *size)
+{
+    char *data;
+
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data = emalloc(*size + 1);
+    if (fread(data, 1, *size, fp) != *size)
+    {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static int
+compress_main (const char *dictfile, int files, char **names)
+{
+    Tty_Dict *dict = dict_load(dictfile);
+    long long in_total = 0, out_total = 0;
+    int f, ret = 0;
+
+    if (dict == NULL) {
+        perror(dictfile);
+        return EXIT_FAILURE;
+    }
+    for (f = 0; f < files; f++) {
+        char *outname = emalloc(strlen(names[f]) + sizeof(ZSUFFIX));
+        FILE *in = efopen(names[f], "r"), *out;
+        long size;
+        char *data = slurp(in, &size);
+
+        efclose(in);
+        if (data == NULL || (size >= 8 && memcmp(data, TTYZ_MAGIC, 8) == 0)) {
+            fprintf(stderr, "%s: %s: %s, skipped\n", get_progname(), names[f],
+                    data ? "already compressed" : "read failed");
+            ret = EXIT_FAILURE;
+            free(data);
+            free(outname);
+            continue;
+        }
+        sprintf(outname, "%s%s", names[f], ZSUFFIX);
+        out = efopen(outname, "w");
+        if (!zio_write(out, data, size, dict)) {
+            perror(outname);
+            exit(EXIT_FAILURE);
+        }
+        in_total += size;
+        out_total += ftell(out);
+        efclose(out);
+        free(data);
+        free(outname);
+    }
+    if (in_total)
+        printf("%lld bytes compressed to %lld (%.1f%%)\n", in_total, out_total, 
+               100.0 * out_total / in_total);
+    return ret;
+}
+
+static int
+expand_main (int files, char **names)
+{
+    int f, ret = 0;
+
+    for (f = 0; f < files; f++) {
+        size_t len = strlen(names[f]), slen = strlen(ZSUFFIX);
+        FILE *in, *out;
+        char magic[8], *outname, *data;
+        long size;
+
+        if (len <= slen || strcmp(names[f] + len - slen, ZSUFFIX) != 0) {
+            fprintf(stderr, "%s: %s: no %s suffix, skipped\n", get_progname(), 
+                    names[f], ZSUFFIX);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        in = efopen(names[f], "r");
+        if (fread(magic, 1, 8, in) != 8 || memcmp(magic, TTYZ_MAGIC, 8) != 0) {
+            fprintf(stderr, "%s: %s: not compressed, skipped\n", get_progname(), 
+                    names[f]);
+            efclose(in);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        in = zio_open(in, names[f]);
+        data = slurp(in, &size);
+        efclose(in);
+        outname = strndup(names[f], len - slen);
+        out = efopen(outname, "w");
+        if (data == NULL || fwrite(data, 1, size, out) != size) {
+            perror(outname);
+            exit(EXIT_FAILURE);
+        }
+        efclose(out);
+        free(outname);
+        free(data);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    long sample_size = SAMPLE_SIZE;
+    int dict_size = TTYDICT_MAX;
+    char *dictfile = NULL;
+    int mode = 0;
+    int ch;
+
+    set_progname(argv[0]);
+    while ((ch = getopt(argc, argv, "t:c:xs:z:")) != EOF)
+    {
+        switch (ch)
+        {
+        case 't':
+        case 'c':
+            dictfile = optarg;
+            /* FALLTHROUGH */
+        case 'x':
+            if (mode)
+                usage(argv[0]);
+            mode = ch;
+            break;
+        case 's':
+            sample_size = atol(optarg);
+            break;
+        case 'z':
+            dict_size = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!mode || optind == argc || sample_size <= 0 || 
+        dict_size < TRAIN_SEGMENT || dict_size > TTYDICT_MAX)
+        usage(argv[0]);
+
+    switch (mode)
+    {
+    case 't':
+        return train_main(dictfile, sample_size, dict_size, argc - optind, argv + optind);
+    case 'c':
+        return compress_main(dictfile, argc - optind, argv + optind);
+    default:
+        return expand_main(argc - optind, argv + optind);
+    }
+}
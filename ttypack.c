@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttypack
+ * 
+ * packs many ttyrec files into one, with a directory of them at the end
+ * 
+ * usage: ttypack -c packfile file [file]...
+ *        ttypack -l packfile
+ *        ttypack -x packfile [name]...
+ * 
+ * -c creates the pack, -l lists what is in it, -x extracts all or the 
+ * named recordings under the current directory, by the paths they were
+ * packed by less any leading /; names with .. are not extracted. 
+ * ttyplay2 and ttytime2 take a pack named *.ttypack for all recordings
+ * in it, PACK:NAME for one by name and PACK@TIME for the one running at
+ * TIME, given as seconds since epoch or YYYY-MM-DDTHH:MM:SS.
+ */
+
+#define _GNU_SOURCE     /* memmem() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+
+#include "io.h"
+#include "pack.h"
+#include "ttyrec.h"
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s -c packfile file [file]...\n", basename(pgmname));
+    printf("       %s -l packfile\n", basename(pgmname));
+    printf("       %s -x packfile [name]...\n", basename(pgmname));
+    printf("  -c  create pack of files\n");
+    printf("  -l  list recordings in pack\n");
+    printf("  -x  extract recordings from pack\n");
+    exit(EXIT_FAILURE);
+}
+
+static long long
+usec (struct timeval tv)
+{
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* time span and keyframes of recording at path into m, returns number
+    of records */
+static long long
+scan (const char *path, Pack_Member *m)
+{
+    FILE *fp = ttyopen(path);
+    Header h, first, last;
+    char *buf = NULL;
+    long long bufsize = 0, records = 0;
+    int key_alloc = 0;
+    long pos;
+
+    m->keys = NULL;
+    m->key_count = 0;
+    memset(&first, 0, sizeof(first));
+    memset(&last, 0, sizeof(last));
+    while (pos = ftell(fp), read_header(fp, &h) && h.len >= 0)
+    {
+        if (h.len > bufsize)
+        {
+            bufsize = h.len;
+            buf = realloc(buf, bufsize);
+            if (buf == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fread(buf, 1, h.len, fp) != h.len)
+            break;
+        if (records++ == 0)
+            first = h;
+        last = h;
+        if (memmem(buf, h.len, CLRSCR, strlen(CLRSCR)) == NULL)
+            continue;
+        if (m->key_count == key_alloc)
+        {
+            key_alloc = key_alloc ? key_alloc * 2 : 16;
+            m->keys = realloc(m->keys, key_alloc * sizeof(Pack_Key));
+            if (m->keys == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        m->keys[m->key_count].offset = pos;
+        m->keys[m->key_count++].time = usec(h.tv) - usec(first.tv);
+    }
+    ttyclose(fp);
+    free(buf);
+    if (records)
+    {
+        m->start = first.tv;
+        m->duration = usec(last.tv) - usec(first.tv);
+    }
+    return records;
+}
+
+static int
+name_cmp (const void *a, const void *b)
+{
+    return strcmp(((Pack_Member *) a)->name, ((Pack_Member *) b)->name);
+}
+
+static int
+create_main (const char *packfile, int files, char **names)
+{
+    Pack_Member *members = emalloc(files * sizeof(Pack_Member)), *sorted;
+    FILE *out = efopen(packfile, "w");
+    int f, count = 0;
+
+    if (!pack_write_start(out))
+    {
+        perror(packfile);
+        exit(EXIT_FAILURE);
+    }
+    for (f = 0; f < files; f++)
+    {
+        Pack_Member *m = &members[count];
+        FILE *in;
+
+        m->name = names[f];
+        while (strncmp(m->name, "./", 2) == 0)
+            m->name += 2;
+        if (scan(names[f], m) == 0)
+        {
+            fprintf(stderr, "%s: %s: no records, skipped\n", get_progname(), names[f]);
+            continue;
+        }
+        in = efopen(names[f], "r");
+        if (!pack_write_member(out, m, in))
+        {
+            perror(packfile);
+            exit(EXIT_FAILURE);
+        }
+        efclose(in);
+        count++;
+    }
+
+    /* names must be unique to be found */
+    sorted = emalloc((count + 1) * sizeof(Pack_Member));
+    memcpy(sorted, members, count * sizeof(Pack_Member));
+    qsort(sorted, count, sizeof(Pack_Member), name_cmp);
+    for (f = 1; f < count; f++)
+    {
+        if (strcmp(sorted[f - 1].name, sorted[f].name) == 0)
+        {
+            fprintf(stderr, "%s: %s given twice\n", get_progname(), sorted[f].name);
+            unlink(packfile);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(sorted);
+
+    if (!pack_write_end(out, members, count))
+    {
+        perror(packfile);
+        exit(EXIT_FAILURE);
+    }
+    printf("%s: %d recording(s), %ld bytes\n", packfile, count, ftell(out));
+    efclose(out);
+    return count == files ? 0 : EXIT_FAILURE;
+}
+
+static int
+list_main (const char *packfile)
+{
+    Pack_Member *m;
+    int count = pack_members(packfile, &m), i;
+
+    if (count < 0)
+    {
+        fprintf(stderr, "%s: %s: not a pack\n", get_progname(), packfile);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < count; i++)
+    {
+        char when[32];
+        time_t t = m[i].start.tv_sec;
+        long long d = m[i].duration / 1000000;
+
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+        printf("%s %lld:%02lld:%02lld %10lld %5d %s\n", when, d / 3600, 
+               d / 60 % 60, d % 60, m[i].size, m[i].key_count, m[i].name);
+    }
+    return 0;
+}
+
+/* 1 if path has a .. component */
+static int
+dotdot (const char *path)
+{
+    const char *p;
+
+    for (p = path; (p = strstr(p, "..")) != NULL; p += 2)
+    {
+        if ((p == path || p[-1] == '/') && (p[2] == 0 || p[2] == '/'))
+            return 1;
+    }
+    return 0;
+}
+
+/* directories leading to path, as mkdir -p; those there already are
+    fine, and any other trouble shows when the file is opened */
+static void
+make_dirs (const char *path)
+{
+    char *dir = strdup(path), *p;
+
+    for (p = strchr(dir + 1, '/'); p != NULL; p = strchr(p + 1, '/'))
+    {
+        *p = 0;
+        mkdir(dir, 0777);
+        *p = '/';
+    }
+    free(dir);
+}
+
+static int
+extract_main (const char *packfile, int names, char **name)
+{
+    Pack_Member *m;
+    int count = pack_members(packfile, &m), i, j, ret = 0;
+    FILE *in;
+
+    if (count < 0)
+    {
+        fprintf(stderr, "%s: %s: not a pack\n", get_progname(), packfile);
+        return EXIT_FAILURE;
+    }
+    in = efopen(packfile, "r");
+    for (j = 0; j < (names ? names : count); j++)
+    {
+        char buf[BUFSIZ];
+        const char *outname;
+        long long left;
+        FILE *out;
+
+        for (i = names ? 0 : j; i < count && names && strcmp(m[i].name, name[j]); i++)
+            ;
+        if (i == count)
+        {
+            fprintf(stderr, "%s: %s: not in pack\n", get_progname(), name[j]);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        outname = m[i].name;
+        while (*outname == '/')
+            outname++;
+        if (*outname == 0 || dotdot(outname))
+        {
+            fprintf(stderr, "%s: %s: unsafe name, not extracted\n", get_progname(), m[i].name);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        make_dirs(outname);
+        out = efopen(outname, "w");
+        fseek(in, m[i].offset, SEEK_SET);
+        for (left = m[i].size; left > 0; )
+        {
+            size_t n = fread(buf, 1, left < sizeof(buf) ? left : sizeof(buf), in);
+            if (n == 0 || fwrite(buf, 1, n, out) != n)
+            {
+                perror(outname);
+                exit(EXIT_FAILURE);
+            }
+            left -= n;
+        }
+        efclose(out);
+    }
+    efclose(in);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int mode = 0;
+    int ch;
+
+    set_progname(argv[0]);
+    while ((ch = getopt(argc, argv, "clx")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'c':
+        case 'l':
+        case 'x':
+            if (mode)
+                usage(argv[0]);
+            mode = ch;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!mode || optind == argc || (mode == 'c' && argc - optind < 2) ||
+        (mode == 'l' && argc - optind != 1))
+        usage(argv[0]);
+
+    switch (mode)
+    {
+    case 'c':
+        return create_main(argv[optind], argc - optind - 1, argv + optind + 1);
+    case 'l':
+        return list_main(argv[optind]);
+    default:
+        return extract_main(argv[optind], argc - optind - 1, argv + optind + 1);
+    }
+}
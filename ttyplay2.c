@@ -30,6 +30,7 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#define _GNU_SOURCE     /* memmem() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -42,15 +43,22 @@
 #include <sys/time.h>
 #include <string.h>
 #include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
 
 #include "ttyrec.h"
 #include "io.h"
+#include "pack.h"
 
 #define DEBUG
 #ifdef DEBUG
 #undef DEBUG_INDEX  /* debug index creation */
 #undef DEBUG_SEEK   /* debug seeking by time offset */
-#undef DEBUG_JUMP  /* debug jumping to next/prev file/clrscr */
+#undef DEBUG_JUMP  /* debug jumping to next/prev file/clrscr/burst/bookmark */
 
 #include <libgen.h>
 #include <sys/stat.h>
@@ -63,7 +71,12 @@
 #define SWITCH_LATENCY 10   /* seconds */
 #define JUMPBASE 15         /* base of how much to jump, sec    */
 #define JUMP_SCALE 10       /* scaling for next bigger jump     */
-#define BUFSIZE 8192        /* max record length (investigated length 4095) */
+#define BUFSIZE 8192        /* chunk of payload searched at a time when indexing */
+#define ACTIVITY_WINDOW 1   /* seconds per activity index window  */
+#define IDLE_GAP 30         /* seconds of no output to count as idle */
+#define SEEK_NOTE (1 << 20)  /* payload a seek replays to tell the user of */
+#define STATUS_HZ 4         /* max status line updates per second  */
+#define MAX_THREADS 64      /* parts a large file is indexed in at once */
 
 /* The role of termios, (n)curses, ANSI escape codes and charsets may 
     be a bit confusing. This is because of historical raisins: curses 
@@ -89,14 +102,13 @@
 
     Well, at least now you know somewhat more. -ObOlli */
 
-/* ANSI escape sequence for clear screen then position cursor at top left */
-#define CLRSCR "\x1b[2J"
+/* CLRSCR, the ANSI escape sequence for clear screen, is in ttyrec.h */
 
 typedef double	(*WaitFunc)	(struct timeval prev, 
 				 struct timeval cur, 
 				 double speed, int *key);
 typedef int	(*ReadFunc)	(FILE *fp, Header *h, char **buf);
-typedef void	(*WriteFunc)	(char *buf, int len);
+typedef void	(*WriteFunc)	(char *buf, long long len);
 typedef void	(*ProcessFunc)	(FILE *fp, double speed, 
 				 ReadFunc read_func, WaitFunc wait_func);
 
@@ -113,9 +125,53 @@ static PControl status = {
     NULL,       /* last clrscr  */
     {0, 0},     /* timeval time_elapsed */
     {0, 0},     /* timeval seek_request */
-    0           /* position in-file */
+    0,          /* position in-file */
+    0,          /* payload bytes elapsed */
+    NULL,       /* activity index */
+    NULL        /* bookmarks */
 };
 
+/* seek requested on command line, as payload byte offset, -1 for none */
+static long long start_offset = -1;
+/* show status line at bottom row of terminal */
+static int status_line_enabled = 0;
+static char status_shown[256];          /* text of status line on screen */
+static long long seek_bytes = -1;       /* payload the last seek replays, estimated */
+static int seeking = 0;                 /* seek_bytes is of a seek under way */
+static volatile sig_atomic_t status_resized = 0;
+/* parts to index a large file in at once, cf. ttysplit() */
+static int index_threads = 1;
+
+/* part of a file indexed by a thread of its own. Its CLRSCRs have their
+    start time and payload from start of part in place of the end until
+    parts are stitched. */
+typedef struct INDEXPART
+{
+    pthread_t thread;
+    File_ID *file_id;
+    FILE *fp;
+    long to, end;               /* end is where indexing stopped */
+    struct timeval file_start;  /* time of first record of file */
+    struct timeval whence;      /* elapsed at start of file */
+    Header first, last;
+    long long records, bytes;
+    Clrscr_ID *first_clrscr, *last_clrscr;
+    Activity *activity;
+} Index_Part;
+
+/* control socket, see control_command() for the protocol */
+#define CONTROL_LINE 256
+static struct
+{
+    int listen_fd;          /* -1 if no control socket */
+    int client_fd;          /* one client at a time, -1 if none */
+    char buf[CONTROL_LINE]; /* partial command line(s) from client */
+    int len;
+    int count;              /* how many files/clrscrs to jump */
+    int pending;            /* reply is due when command is done */
+    struct timeval received;    /* when pending command came in */
+} control = { -1, -1, "", 0, 1, 0, {0, 0} };
+
 /* From glibc-2.2.3 (libc4.18) manual
   (https://ftp.gnu.org/old-gnu/Manuals/glibc-2.2.3/html_node/libc_418.html)
         "It is often necessary to subtract two values of type struct timeval 
@@ -191,6 +247,17 @@ timeval_add (struct timeval tv1, struct timeval tv2)
     return sum;
 }
 
+/* compare timevals, -1/0/1 as in strcmp; does not trust tv_usec to be
+    normalized, as timeval_add above may leave it at exactly 1000000 */
+int
+timeval_cmp (struct timeval tv1, struct timeval tv2)
+{
+    long long us1 = (long long)tv1.tv_sec * 1000000 + tv1.tv_usec;
+    long long us2 = (long long)tv2.tv_sec * 1000000 + tv2.tv_usec;
+
+    return (us1 > us2) - (us1 < us2);
+}
+
 void free_clrscrid(Clrscr_ID *clsid_ptr)
 {
     if(clsid_ptr->next)
@@ -207,6 +274,265 @@ void free_fileid(File_ID *fileid_ptr)
     free(fileid_ptr);
 }
 
+Activity *activity_new(void)
+{
+    Activity *act = (Activity*) malloc(sizeof(Activity));
+    if (act == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    act->windows = NULL;
+    act->window_count = act->window_alloc = 0;
+    act->bursts = NULL;
+    act->burst_count = act->burst_alloc = 0;
+    return act;
+}
+
+void free_activity(Activity *act)
+{
+    free(act->windows);
+    free(act->bursts);
+    free(act);
+}
+
+/* account one record of len bytes at elapsed time `when', which came
+    `gap' after the previous record. Records arrive in time order from 
+    the indexer, so windows and bursts stay sorted by appending. */
+void activity_add(Activity *act, struct timeval when, struct timeval gap, long long len)
+{
+    unsigned int window = when.tv_sec / ACTIVITY_WINDOW;
+    Act_Window *w = act->window_count ? &act->windows[act->window_count-1] : NULL;
+
+    /* the very first record of all files starts a burst, too */
+    if (gap.tv_sec >= IDLE_GAP || act->window_count == 0) {
+        if (act->burst_count == act->burst_alloc) {
+            act->burst_alloc = act->burst_alloc ? act->burst_alloc * 2 : 64;
+            act->bursts = realloc(act->bursts, act->burst_alloc * sizeof(Burst));
+            assert(act->bursts != NULL);
+        }
+        act->bursts[act->burst_count].start = when;
+        act->bursts[act->burst_count].idle = gap.tv_sec;
+        act->burst_count++;
+    }
+
+    if (w == NULL || w->window != window) {
+        if (act->window_count == act->window_alloc) {
+            act->window_alloc = act->window_alloc ? act->window_alloc * 2 : 1024;
+            act->windows = realloc(act->windows, act->window_alloc * sizeof(Act_Window));
+            assert(act->windows != NULL);
+        }
+        w = &act->windows[act->window_count++];
+        w->window = window;
+        w->bytes = w->records = 0;
+    }
+    w->bytes += len;
+    w->records++;
+}
+
+/* append activity src of records following those in act, the first of
+    them `gap' after the last in act, and free src. src was started on 
+    its own, so its first record began a burst whether it did or not. */
+void activity_merge(Activity *act, Activity *src, struct timeval gap)
+{
+    int i = 0;
+
+    if (src->burst_count > 0 && act->window_count > 0 && gap.tv_sec < IDLE_GAP)
+        i = 1;
+    else if (src->burst_count > 0)
+        src->bursts[0].idle = gap.tv_sec;
+    for (; i < src->burst_count; i++) {
+        if (act->burst_count == act->burst_alloc) {
+            act->burst_alloc = act->burst_alloc ? act->burst_alloc * 2 : 64;
+            act->bursts = realloc(act->bursts, act->burst_alloc * sizeof(Burst));
+            assert(act->bursts != NULL);
+        }
+        act->bursts[act->burst_count++] = src->bursts[i];
+    }
+
+    i = 0;
+    if (src->window_count > 0 && act->window_count > 0 &&
+        act->windows[act->window_count-1].window == src->windows[0].window) {
+        act->windows[act->window_count-1].bytes += src->windows[0].bytes;
+        act->windows[act->window_count-1].records += src->windows[0].records;
+        i = 1;
+    }
+    for (; i < src->window_count; i++) {
+        if (act->window_count == act->window_alloc) {
+            act->window_alloc = act->window_alloc ? act->window_alloc * 2 : 1024;
+            act->windows = realloc(act->windows, act->window_alloc * sizeof(Act_Window));
+            assert(act->windows != NULL);
+        }
+        act->windows[act->window_count++] = src->windows[i];
+    }
+    free_activity(src);
+}
+
+/* find burst following (direction > 0) or preceding (direction < 0) 
+    elapsed time `now' by binary search over the burst table, the 
+    |direction|th one that way, or the last there is. Backwards, like 
+    with files, we go to start of the current burst unless we're within
+    SWITCH_LATENCY of it. returns NULL if there is none that way. */
+Burst *activity_find_burst(Activity *act, struct timeval now, int direction)
+{
+    int lo, hi;
+
+    if (act == NULL || act->burst_count == 0)
+        return NULL;
+    lo = 0;
+    hi = act->burst_count;
+    if (direction < 0)
+        now.tv_sec -= SWITCH_LATENCY;
+    /* lo ends up at the first burst starting after now */
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (timeval_cmp(act->bursts[mid].start, now) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (direction > 0) {
+        if (lo == act->burst_count)
+            return NULL;
+        lo += direction - 1;
+        return &act->bursts[lo < act->burst_count ? lo : act->burst_count - 1];
+    }
+    /* going back, the last one at or before now is the first */
+    if (lo == 0)
+        return NULL;
+    lo += direction;
+    return &act->bursts[lo > 0 ? lo : 0];
+}
+
+Bookmarks *bookmarks_new(void)
+{
+    Bookmarks *bms = (Bookmarks*) malloc(sizeof(Bookmarks));
+    if (bms == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    bms->marks = NULL;
+    bms->count = bms->alloc = 0;
+    return bms;
+}
+
+void free_bookmarks(Bookmarks *bms)
+{
+    int i;
+
+    for (i = 0; i < bms->count; i++)
+        free(bms->marks[i].label);
+    free(bms->marks);
+    free(bms);
+}
+
+/* insert bookmark keeping the table sorted; marks mostly come in order,
+    so looking from the end is cheap */
+void bookmark_insert(Bookmarks *bms, struct timeval time, File_ID *file_id, 
+                     const char *label)
+{
+    int i;
+
+    if (bms->count == bms->alloc) {
+        bms->alloc = bms->alloc ? bms->alloc * 2 : 16;
+        bms->marks = realloc(bms->marks, bms->alloc * sizeof(Bookmark));
+        assert(bms->marks != NULL);
+    }
+    for (i = bms->count; i > 0 && timeval_cmp(bms->marks[i-1].time, time) > 0; i--)
+        bms->marks[i] = bms->marks[i-1];
+    bms->marks[i].time = time;
+    bms->marks[i].file_id = file_id;
+    bms->marks[i].label = strdup(label);
+    bms->count++;
+}
+
+/* read sidecar of file_id, if any. file_start is time elapsed from start
+    of all files to start of this one. */
+void load_bookmarks(Bookmarks *bms, File_ID *file_id, struct timeval file_start)
+{
+    char *path = malloc(strlen(file_id->filename) + sizeof(BOOKMARK_SUFFIX));
+    char line[256];
+    FILE *fp;
+
+    assert(path != NULL);
+    sprintf(path, "%s%s", file_id->filename, BOOKMARK_SUFFIX);
+    fp = fopen(path, "r");  /* no sidecar is just fine */
+    free(path);
+    if (fp == NULL)
+        return;
+    while (fgets(line, sizeof(line), fp)) {
+        char *label;
+        double offset = strtod(line, &label);
+        struct timeval time;
+
+        if (label == line || offset < 0)
+            continue;       /* not a bookmark line, ignore */
+        label += strspn(label, " \t");
+        label[strcspn(label, "\r\n")] = 0;
+        time.tv_sec = (long)offset;
+        time.tv_usec = (offset - (long)offset) * 1000000;
+        bookmark_insert(bms, timeval_add(file_start, time), file_id, 
+                        *label ? label : "mark");
+    }
+    fclose(fp);
+}
+
+/* add bookmark at current position, and append it to the sidecar of the
+    current file so it's there next time, too. returns 0 with errno set
+    if the sidecar could not be written; the bookmark is kept anyway. */
+int add_bookmark(Bookmarks *bms, const char *label)
+{
+    File_ID *file_id = status.current_fileid;
+    struct timeval offset = file_id->prev == NULL ? status.time_elapsed :
+        timeval_sub(status.time_elapsed, file_id->prev->last_clrscr->time_elapsed_cls);
+    char *path = malloc(strlen(file_id->filename) + sizeof(BOOKMARK_SUFFIX));
+    FILE *fp;
+
+    bookmark_insert(bms, status.time_elapsed, file_id, label);
+
+    assert(path != NULL);
+    sprintf(path, "%s%s", file_id->filename, BOOKMARK_SUFFIX);
+    fp = fopen(path, "a");
+    free(path);
+    if (fp == NULL)
+        return 0;   /* we still have it for this session */
+    fprintf(fp, "%ld.%06ld %s\n", (long)offset.tv_sec, (long)offset.tv_usec, label);
+    return fclose(fp) == 0;
+}
+
+/* find bookmark following or preceding now, |direction|th that way,
+    cf. activity_find_burst().
+    Bookmarks fall between records, and seeking to one leaves us at the
+    record preceding it, so forwards the caller passes the time of the 
+    upcoming record, and we look for marks at or after it. */
+Bookmark *bookmark_find(Bookmarks *bms, struct timeval now, int direction)
+{
+    int lo, hi;
+
+    if (bms == NULL || bms->count == 0)
+        return NULL;
+    lo = 0;
+    hi = bms->count;
+    if (direction < 0)
+        now.tv_sec -= SWITCH_LATENCY;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (timeval_cmp(bms->marks[mid].time, now) < (direction > 0 ? 0 : 1))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (direction > 0) {
+        if (lo == bms->count)
+            return NULL;
+        lo += direction - 1;
+        return &bms->marks[lo < bms->count ? lo : bms->count - 1];
+    }
+    if (lo == 0)
+        return NULL;
+    lo += direction;
+    return &bms->marks[lo > 0 ? lo : 0];
+}
+
 /* free() with some sanity checks added */
 int release_buffer(char **buf, char *caller)
 {
@@ -223,111 +549,214 @@ int release_buffer(char **buf, char *caller)
     return SUCCESS;
 }
 
-/* update status structure */
+/* payload bytes elapsed at start of file, cf. time elapsed in jump_file() */
+long long file_start_bytes(File_ID *file_id)
+{
+    return file_id->prev == NULL ? 0 : file_id->prev->last_clrscr->bytes_elapsed_cls;
+}
+
+/* update status structure. Position is either 0 for start of file or 
+    record_start of clrscr, and the payload count is set accordingly. */
 void update_status(Clrscr_ID *clrscr, int position, struct timeval time_elapsed)
 {
     status.clrscr = clrscr;
     status.position = position;
     status.time_elapsed = time_elapsed;
     status.current_fileid = status.clrscr->file_id;
+    if (position == 0)
+        status.bytes_elapsed = file_start_bytes(status.current_fileid);
+    else
+        status.bytes_elapsed = clrscr->prev == NULL ? 0 : clrscr->prev->bytes_elapsed_cls;
     /* update fp, too */
     fseek(status.fp, status.position, SEEK_SET);
 }
 
-/* index_one_file returns length of file in timeval */
-struct timeval index_one_file(File_ID *file_id, struct timeval whence_in_cls)
+/* search record payload of len bytes for CLRSCR, a chunk at a time, so 
+    records of any length will do. returns offset of CLRSCR within payload,
+    or -1. fp is left at end of payload. */
+long long payload_find_clrscr(FILE *fp, long long len)
 {
-    int cur_record, bytes_read, clrscr_pos;
-    FILE *fp = efopen(file_id->filename, "r");
-    Header cur_header, prev_header;
-    char buf[BUFSIZE+1], *clrscr_loc; /* leave space in buf for null */
-    Clrscr_ID *prev_clrscr, *cur_clrscr;
-    int prev_was_cls = 0;
-
-    prev_clrscr = NULL;
-#ifdef DEBUG_INDEX
-    int iteration_count = 0;
-    int cls_count = 0;
-#endif
-    prev_header.tv.tv_sec=0;    /* never happens, this is seconds since epoch */
-    while (1)
-    {
-        cur_record = ftell(fp);             /* to set start of current header */
-#ifdef DEBUG_INDEX
-        iteration_count++;
-#endif
-        if (read_header(fp, &cur_header) == 0)      /* read the header  */
-            break;                                  /* EOF              */
-        if (cur_header.len > BUFSIZE) {
-            printf("Record payload of %d exceeds buffer size %d. This is fatal, exiting.", 
-                   cur_header.len, BUFSIZE);
-            exit(EXIT_FAILURE);
+    char buf[BUFSIZE];
+    const int overlap = strlen(CLRSCR) - 1;
+    long long done = 0;
+    int keep = 0;   /* tail of previous chunk at start of buf */
+
+    while (done < len) {
+        int want = len - done < BUFSIZE - keep ? len - done : BUFSIZE - keep;
+        int got = fread(buf + keep, 1, want, fp);
+        char *loc;
+
+        if (got <= 0)
+            break;      /* truncated record */
+        if ((loc = memmem(buf, keep + got, CLRSCR, strlen(CLRSCR))) != NULL) {
+            fseek(fp, len - done - got, SEEK_CUR);  /* skip the rest */
+            return done - keep + (loc - buf);
         }
-        if (prev_header.tv.tv_sec == 0)     /* first header of file */
-            prev_header = cur_header;       /* init for time arithmetic */
+        done += got;
+        /* keep the tail, CLRSCR may go on in the next chunk */
+        if (keep + got > overlap) {
+            memmove(buf, buf + keep + got - overlap, overlap);
+            keep = overlap;
+        } else
+            keep += got;
+    }
+    return -1;
+}
 
-        bytes_read = fread(buf, sizeof(char), cur_header.len, fp); /* record payload*/
-        buf[bytes_read] = 0;                                /* for strstr, need it? */
-        /* keep track of time, for each and every record    */
-        whence_in_cls = timeval_add(whence_in_cls, 
-                    timeval_sub(cur_header.tv, prev_header.tv));
+/* index records of a part of a file, cf. Index_Part */
+static void *index_part(void *arg)
+{
+    Index_Part *p = arg;
+    Header h;
+    long record, payload_pos;
+    long long clrscr_pos;
+
+    while ((record = ftell(p->fp)) < p->to && read_header(p->fp, &h))
+    {
+        /* elapsed time of every record, as its time since start of file */
+        struct timeval when = timeval_add(p->whence, timeval_sub(h.tv, p->file_start));
+        struct timeval gap = {0, 0};
+        Clrscr_ID *cur_clrscr;
 
-        if (!(clrscr_loc = strstr(buf, CLRSCR))) {
-            prev_header = cur_header;                       /* no CLRSCR in record */
+        if (p->records++ == 0)
+            p->first = h;
+        else
+            gap = timeval_sub(h.tv, p->last.tv);
+        p->last = h;
+
+        payload_pos = ftell(p->fp);
+        clrscr_pos = payload_find_clrscr(p->fp, h.len);   /* record payload*/
+        activity_add(p->activity, when, gap, h.len);
+        /* payload count at end of clrscr excludes next clrscr record */
+        p->bytes += h.len;
+        if (clrscr_pos < 0)
             continue;
-        }
 
         /* here we have header and payload with CLRSCR */
-        clrscr_pos = clrscr_loc - buf;      /* position of clrscr in buf    */
         cur_clrscr = (Clrscr_ID*) malloc(sizeof(Clrscr_ID));
-#ifdef DEBUG_INDEX
-        fprintf(stderr, "CLRSCR malloc'd, record #%d at %db %.6fs\n", 
-            iteration_count, cur_record, tv2f(whence_in_cls));
-#endif
+        assert(cur_clrscr != NULL);
+        cur_clrscr->file_id = p->file_id;
+        cur_clrscr->prev = p->last_clrscr;
+        cur_clrscr->next = NULL;
+        if (p->last_clrscr == NULL)
+            p->first_clrscr = cur_clrscr;
+        else
+            p->last_clrscr->next = cur_clrscr;
+        p->last_clrscr = cur_clrscr;
+        cur_clrscr->record_start = record;                  /* pointer into file    */
+        cur_clrscr->position = payload_pos + clrscr_pos;  /* headers vary by format */
+        cur_clrscr->time_elapsed_cls = when;              /* start, for now */
+        cur_clrscr->bytes_elapsed_cls = p->bytes - h.len;
+    }
+    p->end = ftell(p->fp);
+    return NULL;
+}
 
-        /* update uplink to file*/
-        cur_clrscr->file_id = file_id;
-
-        /* chain first clrscr to last file's last */
-        if (prev_clrscr == NULL) {          /* first clrscr of file */
-            if(file_id->prev != NULL) {  /* not first file of the set */
-                prev_clrscr = file_id->prev->last_clrscr;
-                prev_clrscr->next = cur_clrscr;
-                prev_clrscr->time_elapsed_cls = whence_in_cls;
-            } /* else: for first clrscr of first file, NULL is just fine */
-            file_id->first_clrscr = cur_clrscr;
-        } else {            /* just chain us in current file's chain */
-            cur_clrscr->prev = prev_clrscr;
-            prev_clrscr->next = cur_clrscr;
-            /* update previous clrscr's time_elapsed, too */
-            prev_clrscr->time_elapsed_cls = whence_in_cls;
+/* index file_id in up to `parts' parts at once. Returns count of parts,
+    or 0 if they do not meet, i.e. a part started within a record */
+static int index_parts(File_ID *file_id, struct timeval whence, int parts, 
+                       Index_Part *part)
+{
+    FILE *fp[MAX_THREADS];
+    long from[MAX_THREADS + 1];
+    Header first;
+    int k, n = ttysplit(file_id->filename, parts, fp, from);
+
+    first.tv.tv_sec = first.tv.tv_usec = 0;
+    read_header(fp[0], &first);
+    fseek(fp[0], from[0], SEEK_SET);
+    memset(part, 0, n * sizeof(Index_Part));
+    for (k = 0; k < n; k++) {
+        part[k].file_id = file_id;
+        part[k].fp = fp[k];
+        part[k].to = from[k + 1];
+        part[k].file_start = first.tv;
+        part[k].whence = whence;
+        part[k].activity = activity_new();
+        if (k > 0 && pthread_create(&part[k].thread, NULL, index_part, &part[k]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
         }
+    }
+    index_part(&part[0]);
+    for (k = 1; k < n; k++)
+        pthread_join(part[k].thread, NULL);
+    for (k = 0; k < n; k++)
+        ttyclose(fp[k]);
+
+    for (k = 1; k < n && part[k - 1].end == from[k]; k++)
+        ;
+    if (k == n)
+        return n;
+    for (k = 0; k < n; k++) {
+        if (part[k].first_clrscr)
+            free_clrscrid(part[k].first_clrscr);
+        free_activity(part[k].activity);
+    }
+    return 0;
+}
 
-        /* init of the rest of cur_clrscr is straightforward */
-        cur_clrscr->next = NULL;
-        cur_clrscr->file_id = file_id;
-        cur_clrscr->record_start = cur_record;              /* pointer into file    */
-        cur_clrscr->position = cur_record + sizeof(cur_header) + clrscr_pos;
-
-        /* update prev_clrscr ending time */
-        /* for next iteration */
-        prev_clrscr = cur_clrscr;
-        prev_header = cur_header;
+/* index_one_file returns length of file in timeval, and adds the 
+    payload length of file to *whence_bytes. Large files are indexed in
+    parts at once, which are stitched here in order. */
+struct timeval index_one_file(File_ID *file_id, struct timeval whence_in_cls, 
+                              long long *whence_bytes)
+{
+    Index_Part part[MAX_THREADS];
+    Clrscr_ID *prev_clrscr, *cur_clrscr = NULL, *c;
+    struct timeval gap = {0, 0};
+    int k, n;
+
+    load_bookmarks(status.bookmarks, file_id, whence_in_cls);
+    n = index_parts(file_id, whence_in_cls, index_threads, part);
+    if (n == 0)
+        n = index_parts(file_id, whence_in_cls, 1, part);
+
+    file_id->first_clrscr = NULL;
+    for (k = 0; k < n; k++) {
+        if (k > 0 && part[k].records > 0)
+            gap = timeval_sub(part[k].first.tv, part[k - 1].last.tv);
+        activity_merge(status.activity, part[k].activity, gap);
+        for (c = part[k].first_clrscr; c != NULL; c = c->next)
+            c->bytes_elapsed_cls += *whence_bytes;
+        *whence_bytes += part[k].bytes;
+        if (part[k].first_clrscr == NULL)
+            continue;
+        if (cur_clrscr == NULL)
+            file_id->first_clrscr = part[k].first_clrscr;
+        else {
+            cur_clrscr->next = part[k].first_clrscr;
+            part[k].first_clrscr->prev = cur_clrscr;
+        }
+        cur_clrscr = part[k].last_clrscr;
+    }
+    if (part[n - 1].records > 0)
+        whence_in_cls = timeval_add(whence_in_cls, 
+                    timeval_sub(part[n - 1].last.tv, part[0].first.tv));
 #ifdef DEBUG_INDEX
-        cls_count++;
+    fprintf(stderr, "file done at %.6fs in %d part(s).\n", tv2f(whence_in_cls), n);
 #endif
+
+    /* each CLRSCR ends where the next starts, the first of file ends
+        the last of previous file */
+    if (file_id->first_clrscr != NULL && file_id->prev != NULL) {
+        prev_clrscr = file_id->prev->last_clrscr;
+        prev_clrscr->next = file_id->first_clrscr;
+        prev_clrscr->time_elapsed_cls = file_id->first_clrscr->time_elapsed_cls;
+        prev_clrscr->bytes_elapsed_cls = file_id->first_clrscr->bytes_elapsed_cls;
+    }
+    for (c = file_id->first_clrscr; c != NULL && c->next != NULL; c = c->next) {
+        c->time_elapsed_cls = c->next->time_elapsed_cls;
+        c->bytes_elapsed_cls = c->next->bytes_elapsed_cls;
     }
     /* update file_id relevant fields   */
     file_id->last_clrscr = cur_clrscr;
 
-    efclose(fp);
-
-#ifdef DEBUG_INDEX
-    fprintf(stderr, "file done at %.6fs, %d records.\n", 
-        tv2f(whence_in_cls), iteration_count);
-#endif
     /* last CLRSCR-record goes till EOF, which is when we are */
-    cur_clrscr->time_elapsed_cls = whence_in_cls;
+    if (cur_clrscr != NULL) {
+        cur_clrscr->time_elapsed_cls = whence_in_cls;
+        cur_clrscr->bytes_elapsed_cls = *whence_bytes;
+    }
     return(whence_in_cls);
 }
 
@@ -336,9 +765,12 @@ File_ID * create_file_index(int start_arg, int argc, char **argv)
 {
     File_ID *cur_fileid, *prev_file, *first_file;
     struct timeval whence_in_file;
+    long long whence_bytes = 0;
 
     int argp;
 
+    status.activity = activity_new();
+    status.bookmarks = bookmarks_new();
     for (argp = start_arg; argp < argc; argp++)
     {
         cur_fileid = (File_ID*) malloc(sizeof(File_ID));
@@ -358,7 +790,7 @@ File_ID * create_file_index(int start_arg, int argc, char **argv)
             prev_file->next = cur_fileid;
         cur_fileid->next = NULL;
         cur_fileid->filename = strdup(argv[argp]);
-        whence_in_file = index_one_file(cur_fileid, whence_in_file);
+        whence_in_file = index_one_file(cur_fileid, whence_in_file, &whence_bytes);
         /* link the per-file clrscr chain with that of previous file */
         if(cur_fileid->prev != NULL) {  /* the prev file has to exist, of course */
             cur_fileid->first_clrscr->prev = cur_fileid->prev->last_clrscr;
@@ -404,8 +836,9 @@ File_ID * create_file_index(int start_arg, int argc, char **argv)
                             g->next == f ? "ok" : "FAIL");
             g = f;
         }
-        fprintf(stderr, "\tClrscr_ID #%d record at %d actual pos %d ends at %fs\n",
-                ++j, c->record_start, c->position, tv2f(c->time_elapsed_cls));
+        fprintf(stderr, "\tClrscr_ID #%d record at %d actual pos %d ends at %fs %lldb\n",
+                ++j, c->record_start, c->position, tv2f(c->time_elapsed_cls),
+                c->bytes_elapsed_cls);
         if(!c->next) {
             fprintf(stderr, "Sanity check: final clrscr->next is null. Good.\n");
             /* else we burn in infinite loop and crash in segfault ;) */
@@ -446,9 +879,9 @@ int switch_to_file(File_ID *target)
 #endif
     status.current_fileid = target;
     if(!status.fp)
-        status.fp = efopen(target->filename, "r");
+        status.fp = ttyopen(target->filename);
     else
-        freopen(target->filename, "r", status.fp);
+        status.fp = ttyreopen(target->filename, status.fp);
     assert(status.fp != NULL);
     return SUCCESS;
 }
@@ -461,7 +894,7 @@ int switch_to_file(File_ID *target)
 int jump_next_file(int direction)
 {
     if(direction < 0) {
-        if(status.current_fileid->prev == status.current_fileid)
+        if(status.current_fileid->prev == NULL)
             /* already at first file */
             return(direction);
         else {
@@ -517,7 +950,7 @@ int jump_file(int direction)
         /* we jump to start of the file. update status and fp,
             then return without jumping on */
         update_status(status.current_fileid->first_clrscr, 0, 
-            status.current_fileid->prev == status.current_fileid ?
+            status.current_fileid->prev == NULL ?
                 (struct timeval) {0, 0} : 
                 status.current_fileid->prev->last_clrscr->time_elapsed_cls);
         return(0);
@@ -528,14 +961,8 @@ int jump_file(int direction)
     if(!switch_to_file(status.current_fileid))
         exit(EXIT_FAILURE); /* should not happen */
     
-    struct timeval time_elapsed;
-    if(status.current_fileid->prev == status.current_fileid)
-        time_elapsed.tv_sec = time_elapsed.tv_usec = 0;
-    else
-        time_elapsed = status.current_fileid->prev->last_clrscr->time_elapsed_cls;
-
     update_status(status.current_fileid->first_clrscr, 0, 
-        status.current_fileid->prev == status.current_fileid ?
+        status.current_fileid->prev == NULL ?
             (struct timeval) {0, 0} : 
             status.current_fileid->prev->last_clrscr->time_elapsed_cls);
 
@@ -546,30 +973,24 @@ int jump_file(int direction)
     not File_ID. */
 int jump_clrscr(int direction) 
 {
-    /* WIP: we can't really trust status.clrscr is up to date, since the normal
-        operation is just pulling stuff from file and pushing it to screen */
+    /* we can't really trust status.clrscr is up to date, since the normal
+        operation is just pulling stuff from file and pushing it to screen,
+        so the caller sets it from current_clrscr(). The chain goes across
+        files, the caller also switches to the file we end up in. */
 
     if(direction < 0) {
-        if(status.clrscr->prev == status.clrscr) {  /* SOF */
-            if(!switch_to_file(status.clrscr->file_id->prev))
-                return direction;   /* no previous file */
-            status.clrscr = status.current_fileid->last_clrscr;
-        } else {
-            status.clrscr = status.clrscr->prev;
-        }
+        if(status.clrscr->prev == NULL)     /* start of all files */
+            return direction;
+        status.clrscr = status.clrscr->prev;
         /* jumping on implemented as recursion, non-zero return means S/EOF */
         if(jump_clrscr(direction+1) != 0)
             return direction;
     }
 
     if(direction > 0) {     /* mirror of the above */
-        if(status.clrscr->next == NULL) {           /* EOF */
-            if(!switch_to_file(status.clrscr->file_id->next))
-                return direction;   /* no next file */
-            status.clrscr = status.current_fileid->first_clrscr;
-        } else {
-            status.clrscr = status.clrscr->next;
-        }
+        if(status.clrscr->next == NULL)     /* end of all files */
+            return direction;
+        status.clrscr = status.clrscr->next;
         if(jump_clrscr(direction-1) != 0)
             return direction;            
     }
@@ -577,19 +998,39 @@ int jump_clrscr(int direction)
     return(direction);  /* success */
 }
 
-/* seek_index sets struct status to correct file and header position.
+/* clrscr we are playing, by position in current file. Before first 
+    clrscr of file that's the last of previous file, if any. */
+Clrscr_ID *current_clrscr(void)
+{
+    Clrscr_ID *c, *clrscr = status.current_fileid->first_clrscr;
+
+    if (clrscr->record_start > status.position && clrscr->prev != NULL)
+        return clrscr->prev;
+    for (c = clrscr; c != NULL && c->file_id == status.current_fileid; c = c->next)
+        if (c->record_start <= status.position)
+            clrscr = c;
+    return clrscr;
+}
+
+/* switch to file and record of clrscr, and update status accordingly.
     returns FAIL/SUCCESS */
-int seek_index(struct timeval seek_target)
+int goto_clrscr(Clrscr_ID *clrscr)
+{
+    if(!switch_to_file(clrscr->file_id))
+        return FAIL;
+    update_status(clrscr, clrscr->record_start, 
+            /* the elapsed time is found at end of previous clrscr, if any */
+            clrscr->prev == NULL ? 
+                (struct timeval) {0, 0} : clrscr->prev->time_elapsed_cls);
+    return SUCCESS;
+}
+
+/* find the clrscr a seek to seek_target starts replaying from */
+Clrscr_ID *find_clrscr(struct timeval seek_target)
 {
-    File_ID *cur_fileid;
     Clrscr_ID *cur_clrscr;
     struct timeval tdelta;
 
-#ifdef DEBUG_SEEK
-    fprintf(stderr, "Seeking from %lds to %lds\n",
-                    status.time_elapsed.tv_sec, seek_target.tv_sec);
-#endif
-
     /* since clrscr_id is chained from beginning to end, all we need
         is find the correct one */
     cur_clrscr = status.index_head->first_clrscr;
@@ -602,6 +1043,99 @@ int seek_index(struct timeval seek_target)
             break;
         cur_clrscr = cur_clrscr->next;
     }
+    return cur_clrscr;
+}
+
+/* payload bytes in activity windows from..to inclusive */
+long long activity_bytes(Activity *act, struct timeval from, struct timeval to)
+{
+    unsigned int first = from.tv_sec / ACTIVITY_WINDOW;
+    unsigned int last = to.tv_sec / ACTIVITY_WINDOW;
+    int lo = 0, hi = act->window_count;
+    long long bytes = 0;
+
+    while (lo < hi) {       /* first window at or after `from' */
+        int mid = (lo + hi) / 2;
+        if (act->windows[mid].window < first)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < act->window_count && act->windows[lo].window <= last; lo++)
+        bytes += act->windows[lo].bytes;
+    return bytes;
+}
+
+/* estimate of payload a seek to seek_target has to replay from the 
+    clrscr it starts at, without touching the files */
+long long seek_cost(struct timeval seek_target)
+{
+    Clrscr_ID *clrscr = find_clrscr(seek_target);
+
+    return activity_bytes(status.activity, clrscr->prev == NULL ? 
+            (struct timeval) {0, 0} : clrscr->prev->time_elapsed_cls, seek_target);
+}
+
+/* payload bytes of all files */
+long long total_bytes(void)
+{
+    File_ID *file_id = status.index_head;
+
+    while (file_id->next != NULL)
+        file_id = file_id->next;
+    return file_id->last_clrscr->bytes_elapsed_cls;
+}
+
+/* time elapsed at the record holding payload byte `offset', counted 
+    from start of all files. The clrscr is found from the index, and only
+    the headers from its start on are read. */
+struct timeval bytes_to_time(long long offset)
+{
+    Clrscr_ID *clrscr = status.index_head->first_clrscr;
+    struct timeval time;
+    long long bytes;
+    Header h, prev;
+    FILE *fp;
+
+    while (clrscr->next != NULL && clrscr->bytes_elapsed_cls <= offset)
+        clrscr = clrscr->next;
+    time = clrscr->prev == NULL ? (struct timeval) {0, 0} : clrscr->prev->time_elapsed_cls;
+    bytes = clrscr->prev == NULL ? 0 : clrscr->prev->bytes_elapsed_cls;
+
+    fp = ttyopen(clrscr->file_id->filename);
+    fseek(fp, clrscr->record_start, SEEK_SET);
+    if (read_header(fp, &h)) {
+        prev = h;
+        while (bytes + h.len <= offset) {
+            bytes += h.len;
+            fseek(fp, h.len, SEEK_CUR);
+            if (read_header(fp, &h) == 0)
+                break;      /* EOF, the end of clrscr will have to do */
+            time = timeval_add(time, timeval_sub(h.tv, prev.tv));
+            prev = h;
+        }
+    }
+    ttyclose(fp);
+#ifdef DEBUG_SEEK
+    fprintf(stderr, "Payload byte %lld is in record at %.6fs, payload %lldb\n", 
+            offset, tv2f(time), bytes);
+#endif
+    return time;
+}
+
+/* seek_index sets struct status to correct file and header position.
+    returns FAIL/SUCCESS */
+int seek_index(struct timeval seek_target)
+{
+    File_ID *cur_fileid;
+    Clrscr_ID *cur_clrscr;
+
+#ifdef DEBUG_SEEK
+    fprintf(stderr, "Seeking from %lds to %lds\n",
+                    status.time_elapsed.tv_sec, seek_target.tv_sec);
+#endif
+
+    cur_clrscr = find_clrscr(seek_target);
 
 #ifdef DEBUG_SEEK
     fprintf(stderr, "seek_index: found clrscr at %ldb ranging %.6fs through ", 
@@ -622,15 +1156,362 @@ int seek_index(struct timeval seek_target)
     free(fn);
 #endif
     status.current_fileid = cur_fileid;        /* propagate result upwards */
-    if(!switch_to_file(status.current_fileid))
-        return FAIL;
-    update_status(cur_clrscr, cur_clrscr->record_start, 
-            /* the elapsed time is found at end of previous clrscr, if any */
-            cur_clrscr->prev == NULL ? 
-                (struct timeval) {0, 0} : cur_clrscr->prev->time_elapsed_cls);
-    return SUCCESS;
+    return goto_clrscr(cur_clrscr);
 }   
 
+/* format tv_sec as H:MM:SS, dst of HMS_SIZE */
+#define HMS_SIZE 64
+static char *
+hms (char *dst, long sec)
+{
+    snprintf(dst, HMS_SIZE, "%ld:%02ld:%02ld", sec / 3600, sec / 60 % 60, sec % 60);
+    return dst;
+}
+
+/* rows of terminal, 24 if it won't tell */
+static int
+term_rows (void)
+{
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 1)
+        return ws.ws_row;
+    return 24;
+}
+
+/* keep the bottom row for the status line: the rest is made the scroll
+    region (DECSTBM), so output that scrolls leaves the line alone. Set
+    at start and again after the terminal is resized. DECSTBM homes the
+    cursor, hence the DECSC/DECRC around it. */
+static void
+status_region (void)
+{
+    status_shown[0] = 0;    /* to be drawn again */
+    printf("\0337\033[1;%dr\0338", term_rows() - 1);
+}
+
+/* give the whole screen back to scrolling, at exit */
+static void
+status_region_reset (void)
+{
+    if (status_line_enabled)
+        printf("\0337\033[r\0338");
+}
+
+static void
+status_winch (int n)
+{
+    status_resized = 1;
+}
+
+/* draw status line on bottom row of terminal. Cursor and attributes are
+    saved and restored around it (DECSC/DECRC), so the replayed screen does
+    not notice. To keep the cost down, the line is looked at no more than
+    STATUS_HZ times a second unless forced, and redrawn only when its 
+    text changes. Totals of the index are counted once, as the index does
+    not change while playing. */
+void
+status_line (double speed, int force)
+{
+    static struct timeval last_update;
+    static long long total = -1;
+    static long total_sec;
+    static File_ID *shown_file;
+    static int k, n;
+    char line[256], now_s[HMS_SIZE], total_s[HMS_SIZE], seek_s[40] = "";
+    struct timeval now;
+
+    if (!status_line_enabled)
+        return;
+    if (status_resized) {
+        status_resized = 0;
+        status_region();
+        force = 1;
+    }
+    gettimeofday(&now, NULL);
+    if (!force && timeval_diff(last_update, now).tv_sec == 0 &&
+            timeval_diff(last_update, now).tv_usec < 1000000 / STATUS_HZ)
+        return;     /* we'll get there on some later call */
+
+    if (status.index_head) {
+        File_ID *f;
+        if (total < 0) {
+            total = total_bytes();
+            for (f = status.index_head; f->next != NULL; f = f->next)
+                ;
+            total_sec = f->last_clrscr->time_elapsed_cls.tv_sec;
+        }
+        if (shown_file != status.current_fileid) {
+            shown_file = status.current_fileid;
+            k = n = 0;
+            for (f = status.index_head; f != NULL; f = f->next) {
+                n++;
+                if (f == status.current_fileid)
+                    k = n;
+            }
+        }
+        if (seeking && seek_bytes >= SEEK_NOTE)
+            snprintf(seek_s, sizeof(seek_s), "  SEEKING, replaying %lldK", seek_bytes >> 10);
+        snprintf(line, sizeof(line), " %s / %s  %3d%%  x%g  file %d/%d%s%s ",
+                hms(now_s, status.time_elapsed.tv_sec), hms(total_s, total_sec),
+                total ? (int)(status.bytes_elapsed * 100 / total) : 100,
+                speed < 0 ? -speed : speed, k, n, speed < 0 ? "  PAUSED" : "", seek_s);
+    } else {
+        snprintf(line, sizeof(line), " %s  x%g%s ",
+                hms(now_s, status.time_elapsed.tv_sec),
+                speed < 0 ? -speed : speed, speed < 0 ? "  PAUSED" : "");
+    }
+    last_update = now;
+    if (strcmp(line, status_shown) == 0)
+        return;
+    strcpy(status_shown, line);
+    printf("\0337\033[%d;1H\033[0;7m%s\033[0m\033[K\0338", term_rows(), line);
+}
+
+/* create control socket at path, for scripted use of the player */
+void
+control_open (const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Control socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);       /* leftover from previous run */
+    control.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control.listen_fd == -1 ||
+            bind(control.listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+            listen(control.listen_fd, 1) == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* send reply line to client; a client gone away is not our problem */
+void
+control_reply (const char *fmt, ...)
+{
+    char line[CONTROL_LINE * 2];
+    va_list ap;
+    int len;
+
+    if (control.client_fd == -1)
+        return;
+    va_start(ap, fmt);
+    len = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+    if (len > (int) sizeof(line) - 2)
+        len = sizeof(line) - 2;
+    line[len++] = '\n';
+    send(control.client_fd, line, len, MSG_NOSIGNAL);
+}
+
+/* reply with where we are, in key=value form */
+void
+control_reply_position (const char *what, double speed)
+{
+    char latency[32] = "";
+    int k = 0, n = 0;
+    File_ID *f;
+
+    for (f = status.index_head; f != NULL; f = f->next) {
+        n++;
+        if (f == status.current_fileid)
+            k = n;
+    }
+    if (control.pending) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        sprintf(latency, " latency_us=%lld", (long long) 
+                timeval_diff(control.received, now).tv_sec * 1000000 +
+                timeval_diff(control.received, now).tv_usec);
+    }
+    control_reply("OK %s time=%ld.%06ld bytes=%lld total_bytes=%lld file=%d/%d speed=%g "
+            "paused=%d seek_bytes=%lld%s",
+            what, (long) status.time_elapsed.tv_sec, (long) status.time_elapsed.tv_usec,
+            status.bytes_elapsed, status.index_head ? total_bytes() : -1LL, k, n, 
+            speed < 0 ? -speed : speed, speed < 0, seek_bytes, latency);
+}
+
+/* reply with the payload from the current clrscr up to where we are, 
+    which redraws the screen as it is now */
+void
+control_dump (void)
+{
+    Clrscr_ID *clrscr;
+    long long len = 0;
+    char *dump = NULL;
+    Header h;
+    FILE *fp;
+
+    if (status.index_head == NULL) {
+        control_reply("ERR dump needs indexed files");
+        return;
+    }
+    clrscr = current_clrscr();
+    fp = ttyopen(status.current_fileid->filename);
+    /* a clrscr in previous file means we're before first one of this */
+    fseek(fp, clrscr->file_id == status.current_fileid && 
+            clrscr->record_start <= status.position ? clrscr->record_start : 0, SEEK_SET);
+    while (ftell(fp) < status.position && read_header(fp, &h)) {
+        dump = realloc(dump, len + h.len);
+        assert(dump != NULL);
+        len += fread(dump + len, 1, h.len, fp);
+    }
+    ttyclose(fp);
+    control_reply("OK dump %lld", len);
+    if (len)
+        send(control.client_fd, dump, len, MSG_NOSIGNAL);
+    free(dump);
+}
+
+/* command done, send the reply that was held back for it */
+void
+control_done (double speed)
+{
+    if (control.pending) {
+        control_reply_position("done", speed);
+        control.pending = 0;
+    }
+}
+
+/* add control fds to set, returns nfds for select() */
+int
+control_fdset (fd_set *fds, int nfds)
+{
+    int fd = control.client_fd != -1 ? control.client_fd : control.listen_fd;
+
+    if (fd == -1)
+        return nfds;
+    FD_SET(fd, fds);
+    return fd >= nfds ? fd + 1 : nfds;
+}
+
+/* is there a complete command line waiting already? */
+int
+control_line_ready (void)
+{
+    return control.client_fd != -1 && memchr(control.buf, '\n', control.len) != NULL;
+}
+
+/* Execute one command line from the control socket. Commands are
+        pos                 where we are, with payload played and of all
+                            files, and what the last seek replayed
+        speed X             set speed, pause state is kept
+        pause / resume
+        seek SEC            seek to SEC from start of all files
+        skip SEC            seek SEC relative to where we are
+        file N / clrscr N   jump N files/CLRSCRs, negative for back
+        burst N / mark N    jump N bursts/bookmarks, negative for back
+        mark add [LABEL]    bookmark where we are, as the m key does
+        dump                payload since last CLRSCR
+        quit
+    and each gets one reply line starting with OK or ERR. Navigation
+    is replied to when done, with its latency. Commands that navigate are
+    passed on like keypresses, in *key, or as status.seek_request; a seek
+    to where we are is done already. returns speed. */
+double
+control_command (double speed, int *key)
+{
+    char *nl, line[CONTROL_LINE], cmd[CONTROL_LINE], arg[CONTROL_LINE];
+    double value = 0;
+    int n;
+
+    if (!control_line_ready()) {
+        int got;
+        if (control.client_fd == -1) {
+            control.client_fd = accept(control.listen_fd, NULL, NULL);
+            control.len = 0;
+            return speed;
+        }
+        got = read(control.client_fd, control.buf + control.len, 
+                   sizeof(control.buf) - 1 - control.len);
+        if (got <= 0) {         /* client is gone, wait for next */
+            close(control.client_fd);
+            control.client_fd = -1;
+            return speed;
+        }
+        control.len += got;
+        if (!control_line_ready()) {
+            if (control.len == sizeof(control.buf) - 1) {
+                control_reply("ERR line too long");
+                control.len = 0;
+            }
+            return speed;
+        }
+    }
+    nl = memchr(control.buf, '\n', control.len);
+    *nl = 0;
+    strcpy(line, control.buf);
+    n = sscanf(line, "%255s %255s", cmd, arg);
+    if (n == 2)
+        value = atof(arg);
+    control.len -= nl + 1 - control.buf;
+    memmove(control.buf, nl + 1, control.len);
+    gettimeofday(&control.received, NULL);
+    control.count = 1;
+
+    if (n < 1) {
+        control_reply("ERR empty command");
+    } else if (!strcmp(cmd, "pos")) {
+        control_reply_position("pos", speed);
+    } else if (!strcmp(cmd, "speed") && n == 2 && value > 0) {
+        speed = speed < 0 ? -value : value;
+        control_reply_position("speed", speed);
+    } else if (!strcmp(cmd, "pause")) {
+        speed = speed < 0 ? speed : -speed;
+        control_reply_position("pause", speed);
+    } else if (!strcmp(cmd, "resume")) {
+        speed = speed < 0 ? -speed : speed;
+        control_reply_position("resume", speed);
+    } else if (!strcmp(cmd, "dump")) {
+        control_dump();
+    } else if (!strcmp(cmd, "quit")) {
+        control_reply("OK quit");
+        *key = 'q';
+    } else if (status.index_head == NULL) {
+        control_reply("ERR %s needs indexed files", cmd);
+    } else if ((!strcmp(cmd, "seek") || !strcmp(cmd, "skip")) && n == 2) {
+        struct timeval target;
+        if (cmd[1] == 'k')      /* skip */
+            value += status.time_elapsed.tv_sec + status.time_elapsed.tv_usec / 1000000.0;
+        if (value < 0)
+            value = 0;
+        target.tv_sec = (long) value;
+        target.tv_usec = (value - (long) value) * 1000000;
+        status.seek_request = timeval_sub(target, status.time_elapsed);
+        control.pending = 1;
+        if (timeval_cmp(status.seek_request, (struct timeval) {0, 0}) == 0)
+            control_done(speed);
+    } else if (!strcmp(cmd, "mark") && n == 2 && !strcmp(arg, "add")) {
+        char *label = strstr(line, "add") + 3;
+        label += strspn(label, " \t");
+        label[strcspn(label, "\r")] = 0;
+        if (add_bookmark(status.bookmarks, *label ? label : "mark"))
+            control_reply_position("mark", speed);
+        else
+            control_reply("ERR bookmark not saved to %s%s: %s", 
+                    status.current_fileid->filename, BOOKMARK_SUFFIX, strerror(errno));
+    } else if (n == 2 && (int) value != 0 && (!strcmp(cmd, "file") || !strcmp(cmd, "clrscr")
+                || !strcmp(cmd, "burst") || !strcmp(cmd, "mark"))) {
+        control.count = value < 0 ? -(int) value : (int) value;
+        switch (cmd[0]) {
+            case 'f': *key = value > 0 ? 'f' : 'd'; break;
+            case 'c': *key = value > 0 ? 'c' : 'x'; break;
+            case 'b': *key = value > 0 ? 'n' : 'b'; break;
+            case 'm': *key = value > 0 ? '.' : ','; break;
+        }
+        control.pending = 1;
+    } else {
+        control_reply("ERR bad command: %s", line);
+    }
+    return speed;
+}
+
 double
 ttywait (struct timeval prev, struct timeval cur, double speed, int *key)
 {
@@ -638,6 +1519,7 @@ ttywait (struct timeval prev, struct timeval cur, double speed, int *key)
     struct timeval start;
     struct timeval diff = timeval_diff(prev, cur);
     fd_set readfs;
+    int nfds;
 
     gettimeofday(&start, NULL);
 
@@ -651,21 +1533,58 @@ ttywait (struct timeval prev, struct timeval cur, double speed, int *key)
         diff.tv_sec = diff.tv_usec = 0;
     }
 
-    FD_SET(STDIN_FILENO, &readfs);
     /* 
      * We use select() for sleeping with subsecond precision.
-     * select() is also used to wait user's input from a keyboard.
+     * select() is also used to wait user's input from a keyboard,
+     * and from control socket.
      *
      * Save "diff" since select(2) may overwrite it to {0, 0}. 
      */
     struct timeval orig_diff = diff;
-    if(speed <0) {  /* paused? */
 #ifdef DEBUG
-        fprintf(stderr, "Paused at %.3fs\n", tv2f(status.time_elapsed));
+    int told = 0;
 #endif
-        select(1, &readfs, NULL, NULL, NULL);
-    } else {
-        select(1, &readfs, NULL, NULL, &diff);
+    while (1) {
+        struct timeval zero = {0, 0}, now;
+
+        FD_ZERO(&readfs);
+        FD_SET(STDIN_FILENO, &readfs);
+        nfds = control_fdset(&readfs, STDIN_FILENO + 1);
+        if (control_line_ready()) { /* no waiting, command is in already */
+            FD_ZERO(&readfs);
+            select(0, NULL, NULL, NULL, &zero);
+        } else if(speed <0) {  /* paused? */
+            status_line(speed, 1);
+#ifdef DEBUG
+            if (told++)
+                ;       /* once is enough */
+            else if (status.index_head)
+                fprintf(stderr, "Paused at %.3fs, %lldb of %lldb payload\n", 
+                        tv2f(status.time_elapsed), status.bytes_elapsed, total_bytes());
+            else
+                fprintf(stderr, "Paused at %.3fs\n", tv2f(status.time_elapsed));
+#endif
+            select(nfds, &readfs, NULL, NULL, NULL);
+        } else {
+            select(nfds, &readfs, NULL, NULL, &diff);
+        }
+
+        if (!control_line_ready() && !(nfds > STDIN_FILENO + 1 && 
+                FD_ISSET(nfds - 1, &readfs) && !FD_ISSET(0, &readfs)))
+            break;
+        /* control socket, same as keypress wrt drift */
+        speed = control_command(speed, key);
+        drift.tv_sec = drift.tv_usec = 0;
+        if (*key != 0 || timeval_cmp(status.seek_request, zero) != 0)
+            return speed;   /* navigation, done by caller */
+        /* anything else leaves us where we are: still paused, or waiting
+            out what is left of the wait for the next record */
+        if (speed < 0)
+            continue;
+        gettimeofday(&now, NULL);
+        diff = timeval_sub(orig_diff, timeval_diff(start, now));
+        if (diff.tv_sec < 0)
+            return speed;
     }
 
     diff = orig_diff;  /* Restore the original diff value. */
@@ -690,11 +1609,20 @@ ttywait (struct timeval prev, struct timeval cur, double speed, int *key)
                     q - quit
                 some of which are seek-like:
                     f - next file, d - previous file, 
-                    c - next CLRSCR, x - prev CLRSCR */
+                    c - next CLRSCR, x - prev CLRSCR,
+                    n - next burst, b - prev burst,
+                    m - set bookmark, . - next bookmark, 
+                    , - prev bookmark */
             case 'q':
             case 'f':
             case 'd':
+            case 'c':
             case 'x':
+            case 'n':
+            case 'b':
+            case 'm':
+            case ',':
+            case '.':
                 *key = c;
                 break;
             case '\033':    /* ESC starts a key sequence        */
@@ -813,13 +1741,13 @@ ttypread (FILE *fp, Header *h, char **buf)
 }
 
 void
-ttywrite (char *buf, int len)
+ttywrite (char *buf, long long len)
 {
     fwrite(buf, 1, len, stdout);
 }
 
 void
-ttynowrite (char *buf, int len)
+ttynowrite (char *buf, long long len)
 {
     /* do nothing */
 }
@@ -849,6 +1777,12 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
     /* zero seek_request flag/distance and time_elapsed */
     status.seek_request.tv_sec = status.seek_request.tv_usec = 0;
     status.time_elapsed.tv_sec = status.time_elapsed.tv_usec = 0;
+    status.bytes_elapsed = 0;
+    /* seek by payload offset is just a seek to time of that record */
+    if (status.index_head != NULL && start_offset >= 0) {
+        status.seek_request = bytes_to_time(start_offset);
+        start_offset = -1;
+    }
     /* here starts transition to use `PControl *status' */
     status.fp = fp;
 
@@ -859,6 +1793,7 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
         char *buf;
         Header h;
 
+        status.position = ftell(status.fp);     /* where played stuff ends */
         if (read_func(status.fp, &h, &buf) == 0) {
             /* EOF; if we work with indexed files, switch to ->next */
             if(status.index_head && status.current_fileid->next) {
@@ -866,7 +1801,7 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
                 struct timeval time_at_switch = status.time_elapsed;
 #endif
                 status.current_fileid = status.current_fileid->next;
-                freopen(status.current_fileid->filename, "r", status.fp);
+                status.fp = ttyreopen(status.current_fileid->filename, status.fp);
                 assert(status.fp != NULL);
                 update_status(status.current_fileid->first_clrscr, 0, 
                     status.current_fileid->prev == status.current_fileid ?
@@ -890,53 +1825,112 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
             int key = 0;    /* in case wait_func returns the keypress */
             speed = wait_func(prev, h.tv, speed, &key);
 
-            int result = 0;
+            int result = 0, jumped = 0;
             switch(key) {       /* keycode passed us by ttywait()? */
                 case 0:         /* none */
                     break;
                 case 'q':
                     return;     /* quit */
                 case 'f':
-                    result = jump_file(+1);
-                    h.tv = get_header_time(read_func);
+                    result = jump_file(+control.count);
+                    jumped = 1;
 #ifdef DEBUG_JUMP
                     if(result != 0)
-                       fprintf(stderr, "FTI: file jump +1 returned %d\n", result);
+                        fprintf(stderr, "FYI: file jump +%d returned %d\n", control.count, result);
 #endif
                     break;
                 case 'd':
-                    result = jump_file(-1);
-                    h.tv = get_header_time(read_func);
+                    result = jump_file(-control.count);
+                    jumped = 1;
 #ifdef DEBUG_JUMP
                     if(result != 0)
-                        fprintf(stderr, "FYI: file jump -1 returned %d\n", result);
+                        fprintf(stderr, "FYI: file jump -%d returned %d\n", control.count, result);
 #endif
                     break;
                 case 'c':
-                    result = jump_clrscr(+1);
-                    h.tv = get_header_time(read_func);
+                    status.clrscr = current_clrscr();
+                    result = jump_clrscr(+control.count);
+                    if(!goto_clrscr(status.clrscr))
+                        exit(EXIT_FAILURE); /* should not happen */
+                    jumped = 1;
 #ifdef DEBUG_JUMP
                     if(result != 0)
-                        fprintf(stderr, "FYI: clrscr jump +1 returned %d\n", result);
+                        fprintf(stderr, "FYI: clrscr jump +%d returned %d\n", control.count, result);
 #endif
                     break;
                 case 'x':
-                    result = jump_clrscr(-1);
-                    h.tv = get_header_time(read_func);
+                    status.clrscr = current_clrscr();
+                    result = jump_clrscr(-control.count);
+                    if(!goto_clrscr(status.clrscr))
+                        exit(EXIT_FAILURE); /* should not happen */
+                    jumped = 1;
 #ifdef DEBUG_JUMP
                     if(result != 0)
-                        fprintf(stderr, "FYI: clrscr jump -1 returned %d\n", result);
+                        fprintf(stderr, "FYI: clrscr jump -%d returned %d\n", control.count, result);
 #endif
                     break;
+                case 'n':
+                case 'b':
+                    /* bursts are found from the activity index, and we get
+                        there through the ordinary seek below */
+                    if (status.index_head != NULL) {
+                        Burst *burst = activity_find_burst(status.activity,
+                                status.time_elapsed, key == 'n' ? control.count : -control.count);
+                        if (burst != NULL)
+                            status.seek_request = timeval_sub(burst->start, 
+                                                              status.time_elapsed);
+#ifdef DEBUG_JUMP
+                        else
+                            fprintf(stderr, "FYI: no %s burst\n", key == 'n' ? "next" : "prev");
+#endif
+                    }
+                    break;
+                case 'm':
+                    if (status.index_head != NULL && 
+                            !add_bookmark(status.bookmarks, "mark"))
+                        fprintf(stderr, "\r\nBookmark not saved to %s%s: %s\r\n", 
+                                status.current_fileid->filename, BOOKMARK_SUFFIX,
+                                strerror(errno));
+                    break;
+                case '.':
+                case ',':
+                    /* same as bursts, just from the bookmarks */
+                    if (status.index_head != NULL) {
+                        Bookmark *mark = bookmark_find(status.bookmarks, key == '.' ?
+                                timeval_add(status.time_elapsed, timeval_sub(h.tv, prev)) : 
+                                status.time_elapsed, key == '.' ? control.count : -control.count);
+                        if (mark != NULL) {
+                            status.seek_request = timeval_sub(mark->time, 
+                                                              status.time_elapsed);
+#ifdef DEBUG_JUMP
+                            fprintf(stderr, "Bookmark `%s' at %.3fs\n", 
+                                    mark->label, tv2f(mark->time));
+#endif
+                        }
+                    }
+                    break;
                 default:
 #ifdef DEBUG
                     fprintf(stderr, "Unimplemented key request at ttyplay(): %c\n (0x%x)", key, key);
 #endif
                 break;
             }
+            control.count = 1;  /* keys jump by one */
 
-            /* use index_head as flag we indeed have files to seek in */
-            if (status.index_head != NULL && status.seek_request.tv_sec != 0) {
+            if (jumped) {
+                /* the record we waited for is not played, we go on reading 
+                    from where the jump took us, with no wait for it */
+                prev = get_header_time(read_func);
+                if(!release_buffer(&buf, "ttyplay jump"))
+                    exit(EXIT_FAILURE);
+                control_done(speed);
+                continue;
+            }
+
+            /* use index_head as flag we indeed have files to seek in; a 
+                request may be less than a second either way */
+            if (status.index_head != NULL && 
+                    timeval_cmp(status.seek_request, (struct timeval) {0, 0}) != 0) {
                 struct timeval seek_target = 
                     timeval_add(status.time_elapsed, status.seek_request);
                 /* seek_index seeks header preceding CLRSCR and 
@@ -950,6 +1944,17 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
                 free(fn);
                 struct stat stat_before, stat_after;
                 fstat(status.fp, &stat_before);
+#endif
+                /* a seek replays the payload from the clrscr before the 
+                    target, which may take a while; the status line says 
+                    so if it is much, and pos tells it */
+                long long estimate = seek_cost(seek_target);
+                seek_bytes = estimate;
+                seeking = 1;
+                status_line(speed, 1);
+#ifdef DEBUG
+                fprintf(stderr, "Seeking to %.3fs, replaying about %lldb\n",
+                        tv2f(seek_target), estimate);
 #endif
                 if(! seek_index(seek_target))
                     exit(EXIT_FAILURE);     /* TBD: add msg like "seek failed" */
@@ -961,11 +1966,14 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
                 else
                     fprintf(stderr, "File seek DID change inode. Good.\n");
 #endif
+                /* the record we waited for is not played, seek replaces it */
+                if(!release_buffer(&buf, "ttyplay seek"))
+                    exit(EXIT_FAILURE);
                 /* Now we're to CLRSCR record start, next sub-CLRSCR seek   */
-                long int cur_pos = ftell(fp);  /* for reseeking back to start-of-record */
+                long int cur_pos = ftell(status.fp);  /* for reseeking back to start-of-record */
                 int first_loop = 1;
                 struct timeval time_diff;
-                while(read_func(fp, &h, &buf)) {
+                while(read_func(status.fp, &h, &buf)) {
                     if (first_loop) { /* first iteration  */
                         time_diff.tv_sec = time_diff.tv_usec = 0;
                         first_loop = 0;
@@ -978,15 +1986,16 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
                                 -(timeval_sub(seek_target,
                                 timeval_add(status.time_elapsed, time_diff)).tv_sec));
 #endif                        
-                            write_func(buf, h.len);     /* output the record    */
+                            /* not output: it is read again and played in due time */
                             if(!release_buffer(&buf, "ttyplay sub-clrscr seek place #1"))
                                 exit(EXIT_FAILURE);
                             break;
                         }
                     }
 
-                    cur_pos = ftell(fp);
+                    cur_pos = ftell(status.fp);
                     status.time_elapsed = timeval_add(status.time_elapsed, time_diff);   /* where-we-are */
+                    status.bytes_elapsed += h.len;
                     write_func(buf, h.len);             /* output the record    */
                     if(!release_buffer(&buf, "ttyplay sub-clrscr seek place #2"))
                         exit(EXIT_FAILURE);
@@ -994,22 +2003,34 @@ ttyplay (FILE *fp, double speed, ReadFunc read_func,
                 }
                 /* sub-CLRSCR seek ends here, reposition back to 
                    preceding recordfp & clear seek pos/flag         */
-                fseek(fp, cur_pos, SEEK_SET);
+                fseek(status.fp, cur_pos, SEEK_SET);
                 status.seek_request.tv_sec = status.seek_request.tv_usec = 0;   /* seek all done    */
+                seeking = 0;
 #ifdef DEBUG_SEEK
                 struct timeval offset = timeval_diff(seek_target, status.time_elapsed);
-                fprintf(stderr, "Seek complete at position %.3fs %ldb, offset %.3fs\n\n", 
+                fprintf(stderr, "Seek complete at position %.3fs %ldb, offset %.3fs\n", 
                         tv2f(status.time_elapsed), cur_pos, tv2f(offset));
+                fprintf(stderr, "Replayed payload estimated %lldb, actual %lldb\n\n", estimate,
+                        status.bytes_elapsed - (status.clrscr->prev == NULL ? 
+                            0 : status.clrscr->prev->bytes_elapsed_cls));
 #endif
+                control_done(speed);
+                /* buf is spent, and prev is the last record played: go on 
+                    reading from the record the seek stopped at */
+                continue;
             }
+            control_done(speed);
             status.time_elapsed = timeval_add(status.time_elapsed, timeval_sub(h.tv, prev));
         }
         /* here ends transition to use `PControl *status' */
         first_time = 0;
 
         write_func(buf, h.len);
+        status.bytes_elapsed += h.len;
         if(!release_buffer(&buf, "ttyplay end of loop"))
             exit(EXIT_FAILURE);
+        if (write_func == ttywrite)
+            status_line(speed, 0);
  
         prev = h.tv;
    }
@@ -1051,6 +2072,9 @@ help (void)
     printf("    p: pause:\n");
     printf("    d/f: jump to previous/next file\n");
     printf("    x/c: jump to previous/next CLRSCR\n");
+    printf("    b/n: jump to previous/next burst of output after %ds idle\n", IDLE_GAP);
+    printf("    m: set bookmark, saved in FILE%s\n", BOOKMARK_SUFFIX);
+    printf("    ,/.: jump to previous/next bookmark\n");
     printf("    back/forward arrow: seek %d seconds back/forward\n", JUMPBASE);    
     printf("    up/down arrow: seek %d seconds back/forward\n", JUMPBASE*JUMP_SCALE);
     printf("    PgUp/PgDown: seek %d seconds back/forward\n", JUMPBASE*JUMP_SCALE*JUMP_SCALE);
@@ -1067,7 +2091,11 @@ usage (void)
     printf("  -p       Peek another person's ttyrecord\n");
     printf("  -u       utf-8 mode (default: no)\n");
     printf("  -8       8-bit mode (opposite of utf8)\n");
-    printf("  -? or -h print help screen\n");
+    printf("  -o BYTES start at record holding payload byte BYTES of all files\n");
+    printf("  -l       show status line at bottom row of terminal\n");
+    printf("  -c PATH  accept commands from control socket PATH\n");
+    printf("  -? or -h print help screen, with the keys used while playing\n");
+    printf("FILE may be a pack, PACK:NAME or PACK@TIME, cf. ttypack\n");
     exit(EXIT_FAILURE);
 }
 
@@ -1136,6 +2164,7 @@ static struct termios old, new;
 void
 interrupt(int n)
 {
+    status_region_reset();
 #ifdef USE_CURSES
     endwin();
 #else
@@ -1152,10 +2181,14 @@ int main(int argc, char **argv)
     ProcessFunc process = ttyplayback;
     FILE *input = NULL;
     int utf8_mode = 0;
+    char *end;
 
     set_progname(argv[0]);
+    index_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (index_threads < 1 || index_threads > MAX_THREADS)
+        index_threads = index_threads < 1 ? 1 : MAX_THREADS;
     while (1) {
-        int ch = getopt(argc, argv, "s:npu8?h");
+        int ch = getopt(argc, argv, "s:npu8o:lc:?h");
         if (ch == EOF) {
             break;
         }
@@ -1181,6 +2214,19 @@ int main(int argc, char **argv)
         case '8':
             utf8_mode = 0;
             break;
+        case 'o':
+            start_offset = strtoll(optarg, &end, 10);
+            if (*optarg == 0 || *end != 0 || start_offset < 0) {
+                fprintf(stderr, "Bad payload offset: %s\n", optarg);
+                usage();
+            }
+            break;
+        case 'l':
+            status_line_enabled = 1;
+            break;
+        case 'c':
+            control_open(optarg);
+            break;
         case '?':
         case 'h':
             help();
@@ -1190,6 +2236,7 @@ int main(int argc, char **argv)
         }
     }
 
+    argc = pack_expand_args(argc, argv, optind, &argv);   /* packs to members */
     if (optind < argc) {
     status.current_fileid = status.index_head =
         create_file_index(optind, argc, argv);
@@ -1199,7 +2246,7 @@ int main(int argc, char **argv)
     fprintf(stderr, "Opening initial file %s\n\n", basename(fn));
     free(fn);
 #endif                
-        input = efopen(status.current_fileid->filename, "r");
+        input = ttyopen(status.current_fileid->filename);
     } else {
         input = input_from_stdin();
         status.index_head = NULL;
@@ -1216,11 +2263,22 @@ int main(int argc, char **argv)
     initcurses(utf8_mode);
 #endif
     signal(SIGINT, interrupt);
+    if (status_line_enabled) {
+        signal(SIGWINCH, status_winch);
+        status_region();
+    }
     process(input, speed, read_func, wait_func);
 
     if (status.index_head) 
         free_fileid(status.index_head);
-
+    if (status.activity)
+        free_activity(status.activity);
+    if (status.bookmarks)
+        free_bookmarks(status.bookmarks);
+    if (control.listen_fd != -1)
+        close(control.listen_fd);
+
+    status_region_reset();
 #ifdef USE_CURSES
     endwin();
 #else
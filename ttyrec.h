@@ -5,9 +5,213 @@
 
 typedef struct header {
     struct timeval tv;
-    int len;
+    int nsec;           /* sub-microsecond part of time, from extended files */
+    long long len;
 } Header;
 
+/* ANSI escape sequence for clear screen then position cursor at top left */
+#define CLRSCR "\x1b[2J"
+
+/* formats read_header() understands, detected by ttyopen() */
+#define TTYREC_PLAIN    0   /* classic ttyrec, three ints per header */
+#define TTYREC_LITE     1   /* ttyrec-lite, see below */
+#define TTYREC_EXT      2   /* extended precision ttyrec, see below */
+
+/* ttyrec-lite: after a 12 byte file header (TTYLITE_MAGIC, version, 
+    three reserved bytes) come records of
+        varint tag
+            tag & 1:  sync record, followed by varint zigzag(tv_sec) 
+                      and varint tv_usec, both absolute
+            else:     tag >> 1 is zigzag of time delta in usec 
+                      from previous record
+        varint len
+        payload
+    and at the end an index footer of Lite_Sync entries for every sync
+    record, followed by a trailer of footer offset, entry count, reserved
+    and TTYLITE_END. The first record, those with CLRSCR and every 
+    TTYLITE_SYNC_EVERY'th are sync records, so reading may start there.
+    Magics have an invalid tv_usec in them, so no plain ttyrec matches. */
+#define TTYLITE_MAGIC       "TTYLITE\xff"
+#define TTYLITE_END         "TTYLEND\xff"
+#define TTYLITE_VERSION     1
+#define TTYLITE_HEADER      12  /* bytes of file header */
+#define TTYLITE_TRAILER     24  /* bytes of trailer */
+#define TTYLITE_SYNC_EVERY  1024
+#define TTYLITE_SYNC_CLRSCR 1   /* Lite_Sync flag: record has CLRSCR */
+typedef struct LITESYNC
+{
+    long long offset;       /* of record in file */
+    long long tv_sec;
+    unsigned int tv_usec;
+    unsigned int flags;
+} Lite_Sync;                /* 24 bytes little endian in footer */
+
+/* extended precision ttyrec: after a 12 byte file header (TTYEXT_MAGIC,
+    version, three reserved bytes) come records with a header of
+        64 bit tv_sec, 32 bit nanoseconds, 64 bit length
+    all little endian, followed by payload. Plain ttyrec has 32 bit 
+    seconds and lengths, and microseconds. ttyrec-lite keeps 64 bit 
+    lengths, but not nanoseconds. */
+#define TTYEXT_MAGIC        "TTYEXT\xff\xff"
+#define TTYEXT_VERSION      1
+#define TTYEXT_HEADER       12  /* bytes of file header */
+#define TTYEXT_RECORD       20  /* bytes of record header */
+
+/* state of writing a ttyrec-lite file, cf. lite_write_*() in io.c */
+typedef struct LITEWRITER
+{
+    FILE *fp;
+    Header prev;
+    long long records;
+    Lite_Sync *sync;
+    int sync_count, sync_alloc;
+} Lite_Writer;
+
+/* compressed recording: a 26 byte header of TTYZ_MAGIC, version, three
+    reserved bytes, 32 bit id of the dictionary (its adler32, 0 if none),
+    64 bit length of the content and 16 bit length of the dictionary's 
+    file name, then the name, and a zlib stream of the original recording
+    in any format, deflated with the dictionary preset. The dictionary is
+    looked for next to the recording, then in the directories listed in
+    TTYDICT_PATH. */
+#define TTYZ_MAGIC          "TTYZLIB\xff"
+#define TTYZ_VERSION        1
+#define TTYZ_HEADER         26  /* bytes before dictionary name */
+
+/* plain gzip, read with inflate checkpoints for seeking, cf. zio.c */
+#define GZIP_MAGIC          "\x1f\x8b"
+
+/* dictionary file: TTYDICT_MAGIC, version, three reserved bytes, 32 bit
+    id, then the dictionary itself, most useful strings last */
+#define TTYDICT_MAGIC       "TTYDICT\xff"
+#define TTYDICT_VERSION     1
+#define TTYDICT_HEADER      16
+#define TTYDICT_MAX         32768   /* deflate cannot look further back */
+#define TTYDICT_PATH        "TTYDICT_PATH"  /* environment variable */
+
+typedef struct TTY_DICT
+{
+    char *name;                 /* file name without directory */
+    unsigned int id;
+    int size;
+    unsigned char *data;
+} Tty_Dict;
+
+/* pack: many recordings in one file. After a 12 byte header (TTYPACK_MAGIC,
+    version, three reserved bytes) come the recordings as they were, back
+    to back, then a directory with for each of them
+        16 bit length of name, name
+        64 bit offset and size in pack
+        64 bit seconds and 32 bit microseconds of first record
+        64 bit duration in microseconds
+        32 bit count of keyframes, and for each record with CLRSCR
+            64 bit offset in recording, 64 bit microseconds from its start
+    and last a trailer of 64 bit offset of directory, 32 bit count of
+    recordings, 32 bit reserved and TTYPACK_END, all little endian.
+    ttyopen() takes "PACK:NAME" for a recording by name, and "PACK@TIME"
+    for the one running at TIME, from the keyframe before it. Offsets of
+    keyframes are in the recording as ttyopen() reads it, i.e. after
+    decompression. */
+#define TTYPACK_MAGIC       "TTYPACK\xff"
+#define TTYPACK_END         "TTYPEND\xff"
+#define TTYPACK_VERSION     1
+#define TTYPACK_HEADER      12  /* bytes of file header */
+#define TTYPACK_TRAILER     24  /* bytes of trailer */
+#define TTYPACK_BY_NAME     ':'
+#define TTYPACK_BY_TIME     '@'
+#define TTYPACK_SUFFIX      ".ttypack"  /* arguments named so are expanded */
+typedef struct PACKKEY
+{
+    long long offset;       /* of record in recording */
+    long long time;         /* usec since first record */
+} Pack_Key;
+typedef struct PACKMEMBER
+{
+    char *name;
+    long long offset, size; /* in pack */
+    struct timeval start;   /* time of first record */
+    long long duration;     /* usec from first to last record */
+    Pack_Key *keys;
+    int key_count;
+} Pack_Member;
+
+/* columnar export of headers, written by ttytime2 -x, to be mapped into
+    memory as it is: a 40 byte header of TTYCOLS_MAGIC, version, three
+    reserved bytes, 32 bit count of columns, 64 bit count of rows, 32 bit
+    count of files, 32 bit reserved and 64 bit offset of file names, then
+    for each column a 32 byte descriptor of 16 byte name padded with NULs,
+    8 bit type ('u' unsigned, 'i' signed), 8 bit size of a value in bytes,
+    six reserved bytes and 64 bit offset of the column, then the columns,
+    each an array of a value for every row starting at a multiple of 8,
+    and last the names of files, NUL terminated, in order of file id. All
+    little endian. There is a row for each record, in order of files as
+    given and of records in them. Offsets of records are in the recording
+    as ttyopen() reads it. */
+#define TTYCOLS_MAGIC       "TTYCOLS\xff"
+#define TTYCOLS_VERSION     1
+#define TTYCOLS_HEADER      40  /* bytes of file header */
+#define TTYCOLS_COLUMN      32  /* bytes of column descriptor */
+#define TTYCOLS_NAME        16  /* bytes of column name */
+#define TTYCOLS_FILE        0   /* u32 file id */
+#define TTYCOLS_OFFSET      1   /* u64 offset of record in file */
+#define TTYCOLS_TIME        2   /* i64 usec since the epoch */
+#define TTYCOLS_LENGTH      3   /* u64 length of payload */
+#define TTYCOLS_CLRSCR      4   /* u8 1 if payload has CLRSCR, else 0 */
+#define TTYCOLS_COLUMNS     5
+
+/* terminal model, cf. vt.c: a screen of cells that output is played
+    into as xterm would show it. Every cell is one column wide. Cells that
+    change are marked dirty until vt_clean(), and lines about to be lost,
+    by scrolling off the top or clearing the screen, are passed to lost()
+    first if it is set. DEC line drawing is kept as the Unicode 
+    characters it shows. */
+#define VT_BOLD         0x01
+#define VT_DIM          0x02
+#define VT_ITALIC       0x04
+#define VT_UNDERLINE    0x08
+#define VT_BLINK        0x10
+#define VT_REVERSE      0x20
+#define VT_FG           0x40    /* fg is set, else default color */
+#define VT_BG           0x80    /* bg is set, else default color */
+#define VT_PARAMS       16      /* CSI parameters kept */
+#define VT_ROWS         24      /* size of screen unless given */
+#define VT_COLS         80
+#define VT_MAX          1000    /* rows or columns at most */
+#define VT_DEFAULT_FG   0xd0d0d0    /* RGB of default colors */
+#define VT_DEFAULT_BG   0x000000
+typedef struct VTCELL
+{
+    unsigned int ch;        /* Unicode code point, ' ' if blank */
+    unsigned char fg, bg;   /* of 256 xterm colors */
+    unsigned char attr;     /* VT_* */
+    unsigned char reserved;
+} Vt_Cell;
+typedef struct VT
+{
+    int rows, cols;
+    Vt_Cell *screen;        /* rows * cols, of screen shown */
+    Vt_Cell *other;         /* of main screen while alternate one is shown */
+    unsigned char *dirty;   /* for each cell, 1 if changed */
+    int x, y;               /* cursor */
+    int wrap;               /* cursor is past last column, wraps on next char */
+    int top, bottom;        /* scrolling region, rows */
+    int alt;                /* alternate screen is shown */
+    int cursor_hidden, autowrap_off, origin;
+    long long scrolled;     /* lines the whole screen scrolled up so far */
+    Vt_Cell pen;            /* attributes of chars written */
+    int saved_x, saved_y;
+    Vt_Cell saved_pen;
+    char charset[2];        /* G0 and G1, '0' for DEC line drawing */
+    int shift;              /* G1 is in use */
+    int state;              /* of parser, cf. vt.c */
+    int params[VT_PARAMS], nparams;
+    char private, intermediate;
+    unsigned int utf8;      /* code point so far */
+    int utf8_left;          /* continuation bytes to come */
+    void (*lost)(void *ctx, const Vt_Cell *line, int cols);
+    void *ctx;
+} Vt;
+
 /* for indexing/seeking, by ObOlli */
 typedef struct FILEID
 {
@@ -23,10 +227,50 @@ typedef struct CLRSCRID
     long int record_start; /* within file */
     long int position;     /* within file */
     struct timeval time_elapsed_cls; /* tv since start of all files at end */
+    long long bytes_elapsed_cls;     /* payload since start of all files at end */
     struct CLRSCRID *prev;
     struct CLRSCRID *next;
 } Clrscr_ID;
 
+/* activity index: payload volume per window of ACTIVITY_WINDOW seconds,
+    kept only for windows that saw any records, so idle stretches cost
+    nothing. Bursts are records following an idle gap of at least
+    IDLE_GAP seconds, in order of elapsed time. */
+typedef struct ACTWINDOW
+{
+    unsigned int window;    /* elapsed time since start of all files / window */
+    unsigned long long bytes;   /* payload bytes within window */
+    unsigned int records;   /* records within window */
+} Act_Window;
+typedef struct BURST
+{
+    struct timeval start;   /* tv since start of all files */
+    unsigned int idle;      /* length of preceding idle gap, sec */
+} Burst;
+typedef struct ACTIVITY
+{
+    Act_Window *windows;
+    int window_count, window_alloc;
+    Burst *bursts;
+    int burst_count, burst_alloc;
+} Activity;
+
+/* bookmarks, kept in a sidecar file next to each recording as lines of
+    "<seconds from start of that file> <label>". In memory they are 
+    sorted by time since start of all files. */
+#define BOOKMARK_SUFFIX ".bookmarks"
+typedef struct BOOKMARK
+{
+    struct timeval time;    /* tv since start of all files */
+    struct FILEID *file_id; /* recording the sidecar belongs to */
+    char *label;
+} Bookmark;
+typedef struct BOOKMARKS
+{
+    Bookmark *marks;
+    int count, alloc;
+} Bookmarks;
+
 /* Cf. init of `PControl status' if you change anything here */
 typedef struct PCONTROL     /* program control/status */
 {
@@ -37,6 +281,9 @@ typedef struct PCONTROL     /* program control/status */
     struct timeval time_elapsed;
     struct timeval seek_request;
     long int position;      /* within FILE above, bytes */
+    long long bytes_elapsed;    /* payload played since start of all files */
+    Activity *activity;     /* activity index, NULL if not indexed */
+    Bookmarks *bookmarks;   /* bookmarks of all files, NULL if not indexed */
 } PControl;
 
 #endif
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttyshrink
+ * 
+ * rewrites a recording with only what it takes to show the same, for
+ * smaller files and playback over slow links
+ * 
+ * usage: ttyshrink [-l | -p | -x] [-g COLSxROWS] infile outfile
+ * 
+ * the recording is played into a terminal model, cf. vt.c, of 80x24
+ * unless -g is given, and after each record the cells that changed on 
+ * the screen are written out: cursor motion by the shortest of the
+ * sequences that would do, a few unchanged cells written over rather
+ * than moved past, SGR only when attributes change, erasing to end of
+ * line and clearing the screen when they are shorter, and scrolling 
+ * when the screen scrolled. What is written is played into a second 
+ * model of the terminal it will be shown on, and the next record is
+ * diffed against that, so errors cannot build up. Records that change
+ * nothing on the screen are left out, but for the first and the last;
+ * the rest keep their times. The first one clears the screen.
+ * 
+ * the output is in the format of the input unless -l, -p or -x is given,
+ * cf. ttyconv. Titles, bells and modes that do not show on the screen
+ * are dropped, and the alternate screen is shown as the main one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "io.h"
+#include "ttyrec.h"
+#include "vt.h"
+
+#define BRIDGE          8       /* unchanged cells written over at most */
+#define ERASE_MIN       4       /* changed blanks to end of line for EL */
+
+/* what is written for a record, played into the model of the terminal
+    shown on */
+typedef struct ENCODER
+{
+    Vt screen;              /* as the recording shows it */
+    Vt term;                /* as the output shows it */
+    long long scrolled;     /* of screen, as of last record */
+    char *buf;
+    long len, alloc;
+} Encoder;
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s [-l | -p | -x] [-g COLSxROWS] infile outfile\n", basename(pgmname));
+    printf("  -g  size of screen, default %dx%d\n", VT_COLS, VT_ROWS);
+    printf("  -l  write ttyrec-lite\n");
+    printf("  -p  write plain ttyrec\n");
+    printf("  -x  write extended precision ttyrec\n");
+    printf("  format of infile unless given\n");
+    exit(EXIT_FAILURE);
+}
+
+/* append n bytes of s to output, and play them into the terminal */
+static void
+emit (Encoder *e, const char *s, long n)
+{
+    if (e->len + n > e->alloc)
+    {
+        while (e->len + n > e->alloc)
+            e->alloc = e->alloc ? 2 * e->alloc : 65536;
+        if ((e->buf = realloc(e->buf, e->alloc)) == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(e->buf + e->len, s, n);
+    e->len += n;
+    vt_write(&e->term, s, n);
+}
+
+static void
+emit_str (Encoder *e, const char *s)
+{
+    emit(e, s, strlen(s));
+}
+
+static int
+cell_same (const Vt_Cell *a, const Vt_Cell *b)
+{
+    return a->ch == b->ch && a->attr == b->attr && 
+           (!(a->attr & VT_FG) || a->fg == b->fg) && (!(a->attr & VT_BG) || a->bg == b->bg);
+}
+
+/* whether the pen of the terminal writes c as it is, but for its char */
+static int
+pen_fits (const Encoder *e, const Vt_Cell *c)
+{
+    Vt_Cell p = e->term.pen;
+
+    p.ch = c->ch;
+    return cell_same(&p, c);
+}
+
+static int
+row_same (const Vt *a, int ya, const Vt *b, int yb)
+{
+    int x;
+
+    for (x = 0; x < a->cols; x++)
+        if (!cell_same(&a->screen[ya * a->cols + x], &b->screen[yb * b->cols + x]))
+            return 0;
+    return 1;
+}
+
+static int
+color_sgr (char *p, int base, int index)
+{
+    if (index < 8)
+        return sprintf(p, ";%d", base + index);
+    if (index < 16)
+        return sprintf(p, ";%d", base + 60 + index - 8);
+    return sprintf(p, ";%d;5;%d", base + 8, index);
+}
+
+/* SGR from pen to attributes of c, starting with a reset if reset */
+static void
+make_sgr (char *sgr, const Vt_Cell *pen, const Vt_Cell *c, int reset)
+{
+    static const struct { int attr, on, off; } attrs[] = {
+        { VT_BOLD, 1, 22 }, { VT_DIM, 2, 22 }, { VT_ITALIC, 3, 23 }, 
+        { VT_UNDERLINE, 4, 24 }, { VT_BLINK, 5, 25 }, { VT_REVERSE, 7, 27 }
+    };
+    int i, from = reset ? 0 : pen->attr;
+    char *p = sgr;
+
+    p += sprintf(p, reset ? "\x1b[0" : "\x1b[");
+    for (i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++)
+        if ((from & attrs[i].attr) && !(c->attr & attrs[i].attr))
+        {
+            p += sprintf(p, ";%d", attrs[i].off);
+            from &= attrs[i].off == 22 ? ~(VT_BOLD | VT_DIM) : ~attrs[i].attr;
+        }
+    for (i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++)
+        if ((c->attr & attrs[i].attr) && !(from & attrs[i].attr))
+            p += sprintf(p, ";%d", attrs[i].on);
+    if ((c->attr & VT_FG) && (!(from & VT_FG) || pen->fg != c->fg))
+        p += color_sgr(p, 30, c->fg);
+    else if (!(c->attr & VT_FG) && (from & VT_FG))
+        p += sprintf(p, ";39");
+    if ((c->attr & VT_BG) && (!(from & VT_BG) || pen->bg != c->bg))
+        p += color_sgr(p, 40, c->bg);
+    else if (!(c->attr & VT_BG) && (from & VT_BG))
+        p += sprintf(p, ";49");
+    strcpy(p, "m");
+    if (!reset)     /* no ; after [ */
+        memmove(sgr + 2, sgr + 3, strlen(sgr + 3) + 1);
+}
+
+/* set pen of terminal to attributes of c, by changes to it or from a 
+    reset, whichever is shorter */
+static void
+set_pen (Encoder *e, const Vt_Cell *c)
+{
+    char sgr[128], reset[128];
+
+    if (pen_fits(e, c))
+        return;
+    make_sgr(sgr, &e->term.pen, c, 0);
+    make_sgr(reset, &e->term.pen, c, 1);
+    emit_str(e, strlen(reset) < strlen(sgr) ? reset : sgr);
+}
+
+/* write char of cell c at cursor */
+static void
+put_cell (Encoder *e, const Vt_Cell *c)
+{
+    unsigned int ch = c->ch;
+    int dec = ch >= 0x80 ? vt_line_drawing(ch) : 0;
+    char buf[8];
+    Vt_Cell one;
+    int n;
+
+    set_pen(e, c);
+    if (dec && e->term.charset[e->term.shift] != '0')
+        emit_str(e, "\x1b(0");
+    else if (!dec && e->term.charset[e->term.shift] == '0')
+        emit_str(e, "\x1b(B");
+    if (dec)
+    {
+        buf[0] = dec;
+        emit(e, buf, 1);
+        return;
+    }
+    one = *c;
+    n = vt_line_text(&one, 1, buf);
+    emit(e, n ? buf : " ", n ? n : 1);
+}
+
+/* move cursor of terminal to x, y the shortest way */
+static void
+move (Encoder *e, int x, int y)
+{
+    Vt *t = &e->term;
+    char best[32], alt[32];
+
+    if (t->x == x && t->y == y && !t->wrap)
+        return;
+    sprintf(best, "\x1b[%d;%dH", y + 1, x + 1);
+    if (t->wrap)    /* relative moves are not sure to clear the wrap */
+    {
+        emit_str(e, best);
+        return;
+    }
+    if (y == t->y)
+    {
+        if (x == 0)
+            strcpy(alt, "\r");
+        else if (x == t->x - 1)
+            strcpy(alt, "\b");
+        else if (x > t->x)
+            sprintf(alt, "\x1b[%dC", x - t->x);
+        else
+            sprintf(alt, "\x1b[%dD", t->x - x);
+        if (strlen(alt) < strlen(best))
+            strcpy(best, alt);
+        sprintf(alt, "\x1b[%dG", x + 1);
+        if (strlen(alt) < strlen(best))
+            strcpy(best, alt);
+    }
+    else if (y == t->y + 1 && y <= t->bottom && x == 0)
+        strcpy(best, "\r\n");     /* the same with ONLCR, unlike a bare \n */
+    else if (x == t->x)
+    {
+        if (y > t->y)
+            sprintf(alt, "\x1b[%dB", y - t->y);
+        else
+            sprintf(alt, "\x1b[%dA", t->y - y);
+        if (strlen(alt) < strlen(best))
+            strcpy(best, alt);
+    }
+    emit_str(e, best);
+}
+
+/* whether cells x..end of row of cols are all blanks like erasing to
+    end of line gives */
+static int
+blank_to_end (const Vt_Cell *row, int x, int cols)
+{
+    const Vt_Cell *last = &row[cols - 1];
+
+    if (last->ch != ' ' || (last->attr & ~VT_BG))
+        return 0;
+    for (; x < cols; x++)
+        if (!cell_same(&row[x], last))
+            return 0;
+    return 1;
+}
+
+/* write what it takes for the terminal to show the screen */
+void encode(Encoder *e)
+{
+    Vt *s = &e->screen, *t = &e->term;
+    int cols = s->cols, rows = s->rows;
+    int x, y, i, k, n, changed = 0, shown = 0;
+    long long scroll = s->scrolled - e->scrolled;
+
+    e->scrolled = s->scrolled;
+    /* scroll too if more rows come out right that way */
+    if (scroll > 0 && scroll < rows)
+    {
+        int plain = 0, scrolled = 0;
+
+        for (y = 0; y < rows; y++)
+        {
+            plain += row_same(s, y, t, y);
+            scrolled += y < rows - scroll && row_same(s, y, t, y + scroll);
+        }
+        if (scrolled > plain)
+        {
+            Vt_Cell none;
+
+            memset(&none, 0, sizeof(none));
+            set_pen(e, &none);
+            move(e, 0, rows - 1);
+            for (i = 0; i < scroll; i++)
+                emit_str(e, "\n");
+        }
+    }
+    /* clear first if the screen is mostly new */
+    for (i = 0; i < rows * cols; i++)
+    {
+        changed += !cell_same(&s->screen[i], &t->screen[i]);
+        shown += s->screen[i].ch != ' ' || (s->screen[i].attr & VT_BG);
+    }
+    if (changed > shown + 8)
+    {
+        Vt_Cell none;
+
+        memset(&none, 0, sizeof(none));
+        set_pen(e, &none);
+        emit_str(e, "\x1b[H\x1b[2J");
+    }
+
+    for (y = 0; y < rows; y++)
+    {
+        const Vt_Cell *row = &s->screen[y * cols], *old = &t->screen[y * cols];
+
+        for (x = 0; x < cols; x++)
+        {
+            if (cell_same(&row[x], &old[x]))
+                continue;
+            /* erase to end of line if that takes care of enough */
+            for (k = x, n = 0; k < cols; k++)
+                n += !cell_same(&row[k], &old[k]) && row[k].ch == ' ';
+            if (n >= ERASE_MIN && blank_to_end(row, x, cols))
+            {
+                set_pen(e, &row[cols - 1]);
+                move(e, x, y);
+                emit_str(e, "\x1b[K");
+                break;
+            }
+            /* write over a few unchanged cells of the pen rather than move */
+            if (t->y == y && !t->wrap && t->x < x && x - t->x <= BRIDGE)
+            {
+                for (k = t->x; k < x && pen_fits(e, &row[k]) && row[k].ch < 0x80; k++)
+                    ;
+                if (k == x)
+                    for (k = t->x; k < x; k++)
+                        put_cell(e, &row[k]);
+            }
+            move(e, x, y);
+            put_cell(e, &row[x]);
+        }
+    }
+    if (s->cursor_hidden != t->cursor_hidden)
+        emit_str(e, s->cursor_hidden ? "\x1b[?25l" : "\x1b[?25h");
+    move(e, s->x, s->y);
+}
+
+int main(int argc, char **argv)
+{
+    int format = -1, rows = VT_ROWS, cols = VT_COLS, ok, ch, last;
+    long long records = 0, written = 0, bytes_in = 0, bytes_out = 0;
+    Lite_Writer writer;
+    Encoder e;
+    FILE *in, *out;
+    Header h, next;
+    char *buf = NULL;
+    long long bufsize = 0;
+
+    set_progname(argv[0]);
+    while ((ch = getopt(argc, argv, "g:lpx")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'g':
+            if (!vt_parse_size(optarg, &rows, &cols))
+                usage(argv[0]);
+            break;
+        case 'l':
+            format = TTYREC_LITE;
+            break;
+        case 'p':
+            format = TTYREC_PLAIN;
+            break;
+        case 'x':
+            format = TTYREC_EXT;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+
+    in = ttyopen(argv[optind]);
+    if (format < 0)
+        format = ttyformat(in);
+    out = efopen(argv[optind + 1], "w");
+    if (format == TTYREC_LITE)
+        lite_write_start(&writer, out);
+    else if (format == TTYREC_EXT && ext_write_start(out) == 0)
+    {
+        perror(argv[optind + 1]);
+        exit(EXIT_FAILURE);
+    }
+    memset(&e, 0, sizeof(e));
+    vt_init(&e.screen, rows, cols);
+    vt_init(&e.term, rows, cols);
+    emit_str(&e, "\x1b[0m\x1b[H\x1b[2J");
+
+    last = !read_header(in, &next);
+    while (!last)
+    {
+        h = next;
+        if (h.len < 0)
+        {
+            fprintf(stderr, "%s: record #%lld of negative length, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (h.len > bufsize)
+        {
+            bufsize = h.len;
+            if ((buf = realloc(buf, bufsize)) == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fread(buf, 1, h.len, in) != h.len)
+        {
+            fprintf(stderr, "%s: truncated record #%lld, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        last = !read_header(in, &next);
+        vt_write(&e.screen, buf, h.len);
+        encode(&e);
+        records++;
+        bytes_in += h.len;
+        if (e.len == 0 && records > 1 && !last)
+            continue;
+        h.len = e.len;
+        if (format == TTYREC_PLAIN && write_header(out, &h) == 0 && !ferror(out))
+        {
+            fprintf(stderr, "%s: record #%lld does not fit plain ttyrec, "
+                    "use -x\n", argv[optind], records);
+            exit(EXIT_FAILURE);
+        }
+        switch (format)
+        {
+        case TTYREC_LITE:
+            ok = lite_write_record(&writer, &h, e.buf);
+            break;
+        case TTYREC_EXT:
+            ok = ext_write_header(out, &h) && fwrite(e.buf, 1, h.len, out) == h.len;
+            break;
+        default:
+            ok = !ferror(out) && fwrite(e.buf, 1, h.len, out) == h.len;
+        }
+        if (!ok)
+        {
+            perror(argv[optind + 1]);
+            exit(EXIT_FAILURE);
+        }
+        bytes_out += e.len;
+        written++;
+        e.len = 0;
+    }
+    if (format == TTYREC_LITE && !lite_write_end(&writer))
+    {
+        perror(argv[optind + 1]);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "%s: %lld of %lld records kept, %lld of %lld bytes of payload\n",
+            argv[optind], written, records, bytes_out, bytes_in);
+
+    ttyclose(in);
+    efclose(out);
+    vt_free(&e.screen);
+    vt_free(&e.term);
+    free(e.buf);
+    free(buf);
+    return 0;
+}
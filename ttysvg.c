@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttysvg
+ * 
+ * renders a recording into an animated SVG, or an HTML page with it, 
+ * that plays by itself in a browser
+ * 
+ * usage: ttysvg [-H] [-g COLSxROWS] [-i idle] [-r fps] file [outfile]
+ * 
+ * the recording is played into a terminal model, cf. vt.c, of 80x24
+ * unless -g is given. Records less than 1/fps sec (-r, 30 by default)
+ * after the last frame go into the next one. A frame has only the cells
+ * that changed since the one before, drawn over it, and screens that
+ * are no different make none, so the size of the output goes with how
+ * much changes, not with the count of records. Idle time is cut to
+ * -i sec, 2 by default. The animation loops, holding the last frame for
+ * END_HOLD sec. -H writes a self-contained HTML page instead.
+ * 
+ * Frames are shown by CSS animations of their own, written at the end
+ * when the length of the loop is known. The cursor is not drawn.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "io.h"
+#include "ttyrec.h"
+#include "vt.h"
+
+#define FRAME_RATE      30      /* frames per sec at most, unless -r */
+#define IDLE_MAX        2.0     /* sec of idle kept, unless -i */
+#define END_HOLD        2.0     /* sec last frame is shown before looping */
+#define CELL_W          9       /* px */
+#define CELL_H          18
+#define FONT_SIZE       15
+#define BASELINE        14      /* px from top of cell */
+#define BRIDGE          8       /* unchanged cells a run is drawn over at most */
+
+typedef struct SVG
+{
+    FILE *out;
+    Vt vt;
+    Vt_Cell *shown;         /* cells as of last frame */
+    double *times;          /* of frames, sec from start */
+    int frames, alloc;
+} Svg;
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s [-H] [-g COLSxROWS] [-i idle] [-r fps] file [outfile]\n", basename(pgmname));
+    printf("  -H  write an HTML page with the SVG in it\n");
+    printf("  -g  size of screen, default %dx%d\n", VT_COLS, VT_ROWS);
+    printf("  -i  sec of idle time kept at most, default %.0f\n", IDLE_MAX);
+    printf("  -r  frames per sec at most, default %d\n", FRAME_RATE);
+    exit(EXIT_FAILURE);
+}
+
+static int
+cell_same (const Vt_Cell *a, const Vt_Cell *b)
+{
+    return a->ch == b->ch && a->attr == b->attr && 
+           (!(a->attr & VT_FG) || a->fg == b->fg) && (!(a->attr & VT_BG) || a->bg == b->bg);
+}
+
+/* whether a and b look alike but for their characters */
+static int
+style_same (const Vt_Cell *a, const Vt_Cell *b)
+{
+    unsigned int afg, abg, bfg, bbg;
+
+    vt_cell_colors(a, &afg, &abg);
+    vt_cell_colors(b, &bfg, &bbg);
+    return afg == bfg && abg == bbg && 
+           (a->attr & ~(VT_FG | VT_BG | VT_REVERSE)) == (b->attr & ~(VT_FG | VT_BG | VT_REVERSE));
+}
+
+/* character ch in UTF-8, escaped for XML */
+static void
+put_xml (FILE *out, unsigned int ch)
+{
+    if (ch == '&')
+        fputs("&amp;", out);
+    else if (ch == '<')
+        fputs("&lt;", out);
+    else if (ch == '>')
+        fputs("&gt;", out);
+    else if (ch < 0x20 || (ch >= 0xd800 && ch < 0xe000) || ch == 0xfffe || ch == 0xffff)
+        putc('?', out);
+    else if (ch < 0x80)
+        putc(ch, out);
+    else if (ch < 0x800)
+    {
+        putc(0xc0 | (ch >> 6), out);
+        putc(0x80 | (ch & 0x3f), out);
+    }
+    else if (ch < 0x10000)
+    {
+        putc(0xe0 | (ch >> 12), out);
+        putc(0x80 | ((ch >> 6) & 0x3f), out);
+        putc(0x80 | (ch & 0x3f), out);
+    }
+    else
+    {
+        putc(0xf0 | ((ch >> 18) & 0x07), out);
+        putc(0x80 | ((ch >> 12) & 0x3f), out);
+        putc(0x80 | ((ch >> 6) & 0x3f), out);
+        putc(0x80 | (ch & 0x3f), out);
+    }
+}
+
+/* draw n cells of row y from x, all of one style, over old, what was
+    there. That is covered up only if it shows. */
+static void
+draw_run (Svg *s, const Vt_Cell *c, const Vt_Cell *old, int x, int y, int n)
+{
+    unsigned int fg, bg, old_fg, old_bg;
+    int i, len = n;
+
+    vt_cell_colors(c, &fg, &bg);
+    for (i = 0; i < n; i++)
+    {
+        vt_cell_colors(&old[i], &old_fg, &old_bg);
+        if (old[i].ch != ' ' || old_bg != bg)
+            break;
+    }
+    if (i < n)
+        fprintf(s->out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%06x\"/>",
+                x * CELL_W, y * CELL_H, n * CELL_W, CELL_H, bg);
+    while (len > 0 && c[len - 1].ch == ' ')
+        len--;
+    if (len == 0)
+        return;
+    fprintf(s->out, "<text x=\"%d\" y=\"%d\" textLength=\"%d\" fill=\"#%06x\"", 
+            x * CELL_W, y * CELL_H + BASELINE, len * CELL_W, fg);
+    if (c->attr & VT_BOLD)
+        fputs(" font-weight=\"bold\"", s->out);
+    if (c->attr & VT_ITALIC)
+        fputs(" font-style=\"italic\"", s->out);
+    if (c->attr & VT_UNDERLINE)
+        fputs(" text-decoration=\"underline\"", s->out);
+    if (c->attr & VT_DIM)
+        fputs(" opacity=\"0.5\"", s->out);
+    putc('>', s->out);
+    for (i = 0; i < len; i++)
+        put_xml(s->out, c[i].ch);
+    fputs("</text>", s->out);
+}
+
+/* write a frame shown from sec t of the cells that changed since the 
+    last one, if any did */
+void frame(Svg *s, double t)
+{
+    Vt *vt = &s->vt;
+    int x, y, i, n, k, any = 0;
+
+    for (y = 0; y < vt->rows; y++)
+    {
+        for (x = 0; x < vt->cols; x += n)
+        {
+            Vt_Cell *c = &vt->screen[y * vt->cols + x];
+
+            i = y * vt->cols + x;
+            n = 1;
+            if (!vt->dirty[i] || cell_same(c, &s->shown[i]))
+                continue;
+            /* changed cells of a style, and a few unchanged between them */
+            for (k = n; x + k < vt->cols && k - n <= BRIDGE && style_same(c, &c[k]); k++)
+                if (vt->dirty[i + k] && !cell_same(&c[k], &s->shown[i + k]))
+                    n = k + 1;
+            if (!any)
+            {
+                fprintf(s->out, "<g class=\"f\" style=\"animation-name:f%d\">", s->frames);
+                any = 1;
+            }
+            draw_run(s, c, &s->shown[i], x, y, n);
+            memcpy(&s->shown[i], c, n * sizeof(Vt_Cell));
+        }
+    }
+    vt_clean(vt);
+    if (!any)
+        return;
+    fputs("</g>\n", s->out);
+    if (s->frames == s->alloc)
+    {
+        s->alloc = s->alloc ? 2 * s->alloc : 1024;
+        if ((s->times = realloc(s->times, s->alloc * sizeof(double))) == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->times[s->frames++] = t;
+}
+
+int main(int argc, char **argv)
+{
+    int ch, html = 0, rows = VT_ROWS, cols = VT_COLS, fps = FRAME_RATE, pending = 0, i;
+    double idle = IDLE_MAX, t = 0, last = -1, at = 0, loop;
+    long long records = 0;
+    struct timeval prev;
+    char *buf = NULL;
+    long long bufsize = 0;
+    Vt_Cell blank;
+    FILE *in;
+    Header h;
+    Svg s;
+
+    set_progname(argv[0]);
+    while ((ch = getopt(argc, argv, "Hg:i:r:")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'H':
+            html = 1;
+            break;
+        case 'g':
+            if (!vt_parse_size(optarg, &rows, &cols))
+                usage(argv[0]);
+            break;
+        case 'i':
+            idle = atof(optarg);
+            break;
+        case 'r':
+            fps = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2 || fps < 1 || idle < 0)
+        usage(argv[0]);
+
+    in = ttyopen(argv[optind]);
+    memset(&s, 0, sizeof(s));
+    s.out = argc - optind == 2 ? efopen(argv[optind + 1], "w") : stdout;
+    vt_init(&s.vt, rows, cols);
+    s.shown = emalloc(rows * cols * sizeof(Vt_Cell));
+    blank = s.vt.screen[0];
+    for (i = 0; i < rows * cols; i++)
+        s.shown[i] = blank;
+
+    if (html)
+    {
+        const char *p;
+
+        fprintf(s.out, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>");
+        for (p = argv[optind]; *p; p++)    /* bytes of UTF-8 go as they are */
+            if (*p & 0x80)
+                putc(*p, s.out);
+            else
+                put_xml(s.out, *p);
+        fprintf(s.out, "</title></head>\n<body style=\"background:#%06x\">\n", VT_DEFAULT_BG);
+    }
+    else
+        fprintf(s.out, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+    fprintf(s.out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+            "viewBox=\"0 0 %d %d\" font-family=\"monospace\" font-size=\"%d\" "
+            "xml:space=\"preserve\">\n<rect width=\"100%%\" height=\"100%%\" fill=\"#%06x\"/>\n",
+            cols * CELL_W, rows * CELL_H, cols * CELL_W, rows * CELL_H, FONT_SIZE, VT_DEFAULT_BG);
+
+    while (read_header(in, &h))
+    {
+        if (h.len < 0)
+        {
+            fprintf(stderr, "%s: record #%lld of negative length, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (h.len > bufsize)
+        {
+            bufsize = h.len;
+            if ((buf = realloc(buf, bufsize)) == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fread(buf, 1, h.len, in) != h.len)
+        {
+            fprintf(stderr, "%s: truncated record #%lld, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (records > 0)
+        {
+            double gap = (h.tv.tv_sec - prev.tv_sec) + (h.tv.tv_usec - prev.tv_usec) / 1e6;
+
+            t += gap < 0 ? 0 : gap > idle ? idle : gap;
+        }
+        if (pending && (last < 0 || t - last >= 1.0 / fps))
+        {
+            frame(&s, at);
+            last = at;
+        }
+        vt_write(&s.vt, buf, h.len);
+        pending = 1;
+        at = t;
+        prev = h.tv;
+        records++;
+    }
+    if (pending)
+        frame(&s, at);
+
+    /* each frame is hidden until its time in the loop, then shown on top
+        of those before until the loop starts over */
+    loop = at + END_HOLD;
+    fprintf(s.out, "<style>\ng.f{visibility:hidden;animation-duration:%.3fs;"
+            "animation-iteration-count:infinite;animation-timing-function:step-end}\n", loop);
+    for (i = 0; i < s.frames; i++)
+        fprintf(s.out, "@keyframes f%d{%.4f%%,to{visibility:visible}}\n", i, 100 * s.times[i] / loop);
+    fprintf(s.out, "</style>\n</svg>\n");
+    if (html)
+        fprintf(s.out, "</body></html>\n");
+    if (fflush(s.out) == EOF || ferror(s.out))
+    {
+        perror(argc - optind == 2 ? argv[optind + 1] : "stdout");
+        exit(EXIT_FAILURE);
+    }
+    if (s.out != stdout)
+        efclose(s.out);
+    ttyclose(in);
+    vt_free(&s.vt);
+    free(s.shown);
+    free(s.times);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttytext
+ * 
+ * writes the text a session printed, without escape sequences, for
+ * grep and log ingestion
+ * 
+ * usage: ttytext [-r | -t] [-s] [-g COLSxROWS] [-o outfile] file [file]...
+ * 
+ * escape sequences are stripped as they come, also when split across
+ * records. CR LF becomes LF, and a lone CR ends a line that has text in
+ * it. Backspace takes back the last character of the line, other
+ * control characters are dropped. Cursor positioning and clearing the
+ * screen end a line, moving the cursor forward gives spaces.
+ * 
+ * -s plays the recording into a terminal model instead, cf. vt.c, of a
+ * screen of 80x24 unless -g is given, and writes each line as it scrolls
+ * off the top or the screen is cleared, and the screen as it is at the
+ * end of each file. Text drawn out of order by cursor motion then comes
+ * out as it was shown. Trailing blank lines of a screen are left out.
+ * 
+ * -t prefixes each line with the local time of the record it starts in,
+ * -r with seconds since the first record of the first file. With -s, 
+ * it is the record the line left the screen in.
+ * 
+ * text runs between control characters are found 8 bytes at a time, so
+ * the usual output goes through at about the speed of reading.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <stdint.h>
+
+#include "io.h"
+#include "ttyrec.h"
+#include "vt.h"
+
+#define STAMP_NONE      0
+#define STAMP_TIME      1   /* -t, local time */
+#define STAMP_ELAPSED   2   /* -r, sec since first record */
+
+#define FORWARD_MAX     256 /* spaces for moving cursor forward, at most */
+#define OUT_BUFFER      (1 << 20)
+
+/* states of the stripper */
+#define S_TEXT          0
+#define S_ESC           1   /* after ESC */
+#define S_ESC_INTER     2   /* ESC, intermediates, wait for final */
+#define S_CSI           3   /* ESC [, parameters until final */
+#define S_STRING        4   /* OSC, DCS, SOS, PM, APC until BEL or ST */
+#define S_STRING_ESC    5   /* ESC in string, ST if \ follows */
+
+/* words of 8 bytes, and whether one has a byte that is not text */
+#define ONES            0x0101010101010101ULL
+#define HIGHS           0x8080808080808080ULL
+#define HAS_LESS(x, n)  (((x) - ONES * (n)) & ~(x) & HIGHS)
+#define HAS_ZERO(x)     HAS_LESS(x, 1)
+#define NOT_TEXT(x)     (HAS_LESS(x, 0x20) | HAS_ZERO((x) ^ (ONES * 0x7f)))
+
+typedef struct STRIPPER
+{
+    int state;
+    int param;              /* first parameter of CSI so far, -1 if none */
+    int cr;                 /* CR came last */
+    char *line;             /* text of line so far */
+    long len, alloc;
+    int started;            /* line has begun, stamp is set */
+    struct timeval stamp;   /* of record line began in */
+    struct timeval start;   /* first record, for STAMP_ELAPSED */
+    int stamps;             /* STAMP_* */
+    FILE *out;
+    Vt *vt;                 /* with -s, NULL if stripping */
+    struct timeval now;     /* of record played into vt */
+} Stripper;
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s [-r | -t] [-s] [-g COLSxROWS] [-o outfile] file [file]...\n", basename(pgmname));
+    printf("  -g  size of screen with -s, default %dx%d\n", VT_COLS, VT_ROWS);
+    printf("  -r  prefix lines with seconds since first record\n");
+    printf("  -s  lines as they leave the screen of a terminal model\n");
+    printf("  -t  prefix lines with local time\n");
+    exit(EXIT_FAILURE);
+}
+
+static void
+line_grow (Stripper *s, long n)
+{
+    if (s->len + n <= s->alloc)
+        return;
+    while (s->len + n > s->alloc)
+        s->alloc = s->alloc ? 2 * s->alloc : 4096;
+    if ((s->line = realloc(s->line, s->alloc)) == NULL)
+    {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+line_add (Stripper *s, const char *p, long n, const struct timeval *tv)
+{
+    if (!s->started)
+    {
+        s->stamp = *tv;
+        s->started = 1;
+    }
+    line_grow(s, n);
+    memcpy(s->line + s->len, p, n);
+    s->len += n;
+}
+
+/* write the line, with its stamp, and start the next. If empty, the line
+    is written only if always. */
+static void
+line_end (Stripper *s, int always)
+{
+    if (s->len == 0 && !always)
+        return;
+    if (s->stamps == STAMP_TIME && s->started)
+    {
+        char buf[32];
+        time_t t = s->stamp.tv_sec;
+
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        fprintf(s->out, "%s.%03ld ", buf, (long)s->stamp.tv_usec / 1000);
+    }
+    else if (s->stamps == STAMP_ELAPSED && s->started)
+    {
+        long long us = (s->stamp.tv_sec - s->start.tv_sec) * 1000000LL + 
+                       s->stamp.tv_usec - s->start.tv_usec;
+
+        fprintf(s->out, "%10lld.%03lld ", us / 1000000, us % 1000000 / 1000);
+    }
+    fwrite(s->line, 1, s->len, s->out);
+    putc('\n', s->out);
+    s->len = 0;
+    s->started = 0;
+}
+
+/* take back the last character of the line, all bytes of it in UTF-8 */
+static void
+line_back (Stripper *s)
+{
+    while (s->len > 0 && (s->line[s->len - 1] & 0xc0) == 0x80)
+        s->len--;
+    if (s->len > 0)
+        s->len--;
+}
+
+/* end of CSI with final byte c */
+static void
+csi_final (Stripper *s, int c, const struct timeval *tv)
+{
+    int n = s->param > 0 ? s->param : 1;
+
+    switch (c)
+    {
+    case 'H':   /* cursor position */
+    case 'f':
+    case 'J':   /* erase in display */
+        line_end(s, 0);
+        break;
+    case 'C':   /* cursor forward */
+        if (n > FORWARD_MAX)
+            n = FORWARD_MAX;
+        line_add(s, "", 0, tv);     /* for the stamp */
+        line_grow(s, n);
+        memset(s->line + s->len, ' ', n);
+        s->len += n;
+        break;
+    }
+}
+
+/* a control character in text */
+static void
+control (Stripper *s, int c, const struct timeval *tv)
+{
+    switch (c)
+    {
+    case '\n':
+        line_add(s, "", 0, tv);     /* for the stamp of an empty line */
+        line_end(s, 1);
+        break;
+    case '\r':
+        s->cr = 1;
+        return;
+    case '\b':
+        line_back(s);
+        break;
+    case '\x1b':
+        s->state = S_ESC;
+        break;
+    }
+}
+
+/* strip n bytes of payload of a record of time tv */
+void strip(Stripper *s, const unsigned char *p, long n, const struct timeval *tv)
+{
+    const unsigned char *end = p + n;
+    int c;
+
+    while (p < end)
+    {
+        if (s->state == S_TEXT)
+        {
+            const unsigned char *run = p;
+            uint64_t x;
+
+            /* a lone CR ends a line with text in it, CR LF is LF */
+            if (s->cr && *p != '\r')
+            {
+                s->cr = 0;
+                if (*p != '\n')
+                    line_end(s, 0);
+            }
+            while (end - p >= 8)
+            {
+                memcpy(&x, p, 8);
+                if (NOT_TEXT(x))
+                    break;
+                p += 8;
+            }
+            while (p < end && *p >= 0x20 && *p != 0x7f)
+                p++;
+            if (p > run)
+                line_add(s, (const char *)run, p - run, tv);
+            if (p == end)
+                break;
+            control(s, *p++, tv);
+            continue;
+        }
+        c = *p++;
+        if (c == 0x18 || c == 0x1a)     /* CAN and SUB cancel */
+        {
+            s->state = S_TEXT;
+            continue;
+        }
+        switch (s->state)
+        {
+        case S_ESC:
+            if (c == '[')
+            {
+                s->state = S_CSI;
+                s->param = -1;
+            }
+            else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_')
+                s->state = S_STRING;
+            else if (c >= 0x20 && c < 0x30)
+                s->state = S_ESC_INTER;
+            else if (c == '\x1b')
+                s->state = S_ESC;
+            else if (c >= 0x30)
+                s->state = S_TEXT;
+            break;
+        case S_ESC_INTER:
+            if (c >= 0x30)
+                s->state = S_TEXT;
+            else if (c == '\x1b')
+                s->state = S_ESC;
+            break;
+        case S_CSI:
+            if (c >= '0' && c <= '9' && s->param < 10000)
+                s->param = (s->param < 0 ? 0 : 10 * s->param) + c - '0';
+            else if (c >= 0x40 && c <= 0x7e)
+            {
+                s->state = S_TEXT;
+                csi_final(s, c, tv);
+            }
+            else if (c == '\x1b')
+                s->state = S_ESC;
+            else if (c < 0x20)
+                control(s, c, tv);  /* done in the middle, as terminals do */
+            break;
+        case S_STRING:
+            if (c == '\a')
+                s->state = S_TEXT;
+            else if (c == '\x1b')
+                s->state = S_STRING_ESC;
+            break;
+        case S_STRING_ESC:
+            s->state = c == '\\' ? S_TEXT : S_STRING;
+            break;
+        }
+    }
+}
+
+/* line lost from the screen of s->vt, cf. Vt */
+static void
+scrollback (void *ctx, const Vt_Cell *line, int cols)
+{
+    Stripper *s = ctx;
+
+    line_grow(s, 4 * cols + 1);
+    s->len = vt_line_text(line, cols, s->line);
+    s->stamp = s->now;
+    s->started = 1;
+    line_end(s, 1);
+}
+
+/* strip all records of filename to s, or play them into s->vt */
+void strip_file(Stripper *s, const char *filename, int first)
+{
+    FILE *fp = ttyopen(filename);
+    unsigned char *buf = NULL;
+    long long bufsize = 0, records = 0;
+    Header h;
+
+    while (read_header(fp, &h))
+    {
+        if (h.len < 0)
+        {
+            fprintf(stderr, "%s: record #%lld of negative length, rest is dropped\n", 
+                    filename, records + 1);
+            break;
+        }
+        if (h.len > bufsize)
+        {
+            bufsize = h.len;
+            if ((buf = realloc(buf, bufsize)) == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fread(buf, 1, h.len, fp) != h.len)
+        {
+            fprintf(stderr, "%s: truncated record #%lld, rest is dropped\n", 
+                    filename, records + 1);
+            break;
+        }
+        if (first && records == 0)
+            s->start = h.tv;
+        if (s->vt)
+        {
+            s->now = h.tv;
+            vt_write(s->vt, (char *)buf, h.len);
+        }
+        else
+            strip(s, buf, h.len, &h.tv);
+        records++;
+    }
+    if (s->vt)
+        vt_reset(s->vt);    /* gives what is left on the screen */
+    line_end(s, 0);     /* a file starts on a line of its own */
+    s->state = S_TEXT;
+    s->cr = 0;
+    ttyclose(fp);
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    Stripper s;
+    Vt vt;
+    char *outfile = NULL;
+    int ch, i, model = 0, rows = VT_ROWS, cols = VT_COLS;
+
+    set_progname(argv[0]);
+    memset(&s, 0, sizeof(s));
+    while ((ch = getopt(argc, argv, "g:o:rst")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'g':
+            if (!vt_parse_size(optarg, &rows, &cols))
+                usage(argv[0]);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 's':
+            model = 1;
+            break;
+        case 'r':
+            s.stamps = STAMP_ELAPSED;
+            break;
+        case 't':
+            s.stamps = STAMP_TIME;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    s.out = outfile ? efopen(outfile, "w") : stdout;
+    setvbuf(s.out, NULL, _IOFBF, OUT_BUFFER);
+    if (model)
+    {
+        vt_init(&vt, rows, cols);
+        vt.lost = scrollback;
+        vt.ctx = &s;
+        s.vt = &vt;
+    }
+    for (i = optind; i < argc; i++)
+        strip_file(&s, argv[i], i == optind);
+    if (fflush(s.out) == EOF || ferror(s.out))
+    {
+        perror(outfile ? outfile : "stdout");
+        exit(EXIT_FAILURE);
+    }
+    if (outfile)
+        efclose(s.out);
+    if (model)
+        vt_free(&vt);
+    free(s.line);
+    return 0;
+}
@@ -36,7 +36,57 @@
  * 
  * small (and in places quite ugly) utility to analyze a bunch of ttyrec files
  * 
- * usage: ttytime2 file [file]...
+ * usage: ttytime2 [-a] [-C cachefile] [-g group] [-j threads] [-o partial] [-t n] 
+ *                 [-x export] file [file]...
+ *        ttytime2 -q [-C cachefile] [-g group] [-j threads] file [file]...
+ *        ttytime2 -m [-o partial] partial [partial]...
+ *        ttytime2 -e chunks file [file]...
+ * 
+ * a file named *.ttypack stands for all recordings in it, cf. ttypack
+ * 
+ * with -C, results of each file are kept in cachefile, keyed by device,
+ * inode, size and mtime, and only files not found there unchanged are
+ * read. Recordings in packs are not cached, and files not given in a 
+ * run are dropped from it.
+ * 
+ * -o writes the totals to a partial result file, and -m merges partial
+ * results given instead of files, so shards of an archive can be 
+ * analyzed separately and reported on as one.
+ * 
+ * files are read by as many as -j threads at once, by default one for
+ * each processor online. Threads left over when there are fewer files
+ * read files of 16 MB and more in parts at once, if they are read 
+ * directly, not decompressed or from a pack. The parts are stitched at
+ * records where they meet.
+ * 
+ * -g totals files by group, too: "day" or "month" of first record, or 
+ * else the first capture of an extended regular expression in the path,
+ * or the whole match if it has none. Files that do not match are in
+ * group "-".
+ * 
+ * -a reports anomalies of each file in the same pass: time going back,
+ * gaps of a day or more, records of a megabyte or more, and a last 
+ * record cut short or bytes after it, each with offset in file. A 
+ * header of negative length ends the file there.
+ * 
+ * -t lists the n longest files, largest records, longest gaps between
+ * records and busiest windows of TOP_WINDOW seconds of all files, each
+ * with offset of record in file and seconds from its start. They are 
+ * kept in heaps of n, so memory does not grow with the archive.
+ * 
+ * -x writes all headers to a columnar file of file id, offset, time,
+ * length and CLRSCR flag, cf. TTYCOLS in ttyrec.h, for other tools to
+ * map into memory. Each file is read through by one thread then, with
+ * its rows spooled to temporary files per column while all are read.
+ * 
+ * -q only finds out durations, from the first and last header of each
+ * file, the latter looked for backward from the end of file. Files where
+ * that does not work out are read through.
+ * 
+ * -e estimates record counts and both distributions from chunks of
+ * records read at random places in each file, for archives too large
+ * to read through. Durations are found out as with -q, and small files
+ * are read through. Estimates come with a 95% confidence interval.
  * 
  * prints for each file
  *  * duration in sec
@@ -49,133 +99,1738 @@
  *  * log2 distribution of time duration of records with log2 histogram
  */
 
+#define _GNU_SOURCE     /* memmem() */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
 #include <math.h>
 #include <libgen.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <regex.h>
+#include <time.h>
 
 #include "io.h"
+#include "pack.h"
 #include "ttyrec.h"
 
-int calc_time(const char *filename, int *times, int *lengths, int *records)
+#define LENGTH_BUCKETS 64   /* log2 of record lengths, up to 64 bits */
+#define TIME_BUCKETS   64   /* log2 of seconds between records */
+#define MAX_THREADS    64
+
+/* anomalies reported with -a */
+#define ANOMALY_BACK    0   /* time goes back, by usec */
+#define ANOMALY_GAP     1   /* no records for ANOMALY_GAP_SEC or more, usec */
+#define ANOMALY_LEN     2   /* record of ANOMALY_LEN_MAX bytes or more */
+#define ANOMALY_CUT     3   /* payload of last record cut short, by bytes */
+#define ANOMALY_TAIL    4   /* bytes after last record that are none */
+#define ANOMALY_GAP_SEC (24 * 3600)
+#define ANOMALY_LEN_MAX (1 << 20)
+#define ANOMALY_KEEP    100 /* reported per file, the rest only counted */
+
+/* cache file: 16 byte header of CACHE_MAGIC, version, three reserved 
+    bytes and 32 bit count of entries, then entries of 64 bit device, 
+    inode, size, mtime in nanoseconds, duration, records, seconds of 
+    first record since the epoch (-1 if none) and counts of lengths and
+    times, all little endian, sorted by device and inode */
+#define CACHE_MAGIC     "TTYTIME\xff"
+#define CACHE_VERSION   3
+#define CACHE_HEADER    16
+#define CACHE_ENTRY     (56 + 8 * (LENGTH_BUCKETS + TIME_BUCKETS))
+
+/* partial results, to be merged with -m: 16 byte header of PART_MAGIC,
+    version, three reserved bytes and 32 bit count of files, then 64 bit
+    duration, records and counts of lengths and times, little endian */
+#define PART_MAGIC      "TTYPART\xff"
+#define PART_VERSION    1
+#define PART_HEADER     16
+#define PART_SIZE       (PART_HEADER + 8 * (2 + LENGTH_BUCKETS + TIME_BUCKETS))
+
+/* estimating with -e: files up to SAMPLE_FULL bytes are read through,
+    from others as many chunks as asked for of up to SAMPLE_RECORDS
+    records each, at random places */
+#define SAMPLE_FULL     (1024 * 1024)
+#define SAMPLE_RECORDS  256
+#define SAMPLE_SEED     1
+#define SAMPLE_TRIES    4       /* places to try for a chunk in its stratum */
+#define SAMPLE_Z        1.96    /* for 95% confidence */
+
+/* results of one file, or totals of many */
+typedef struct STATS
 {
-    Header start, end, prev, curr;
+    long long duration;
+    long long records;
+    long long lengths[LENGTH_BUCKETS];
+    long long times[TIME_BUCKETS];
+} Stats;
+
+/* estimated totals, with variances of estimates */
+typedef struct ESTIMATE
+{
+    long long duration;
+    double records, var_records;
+    double lengths[LENGTH_BUCKETS], var_lengths[LENGTH_BUCKETS];
+    double times[TIME_BUCKETS], var_times[TIME_BUCKETS];
+    long long bytes, sampled;
+} Estimate;
+
+typedef struct ANOMALY
+{
+    long long offset;       /* of record in file */
+    int kind;               /* ANOMALY_* */
+    long long value;
+} Anomaly;
+
+typedef struct ANOMALIES
+{
+    Anomaly list[ANOMALY_KEEP];     /* first ones found */
+    long long count;
+} Anomalies;
+
+/* top lists with -t, each kept in a heap of fixed size */
+#define TOP_FILES       0   /* longest files, sec */
+#define TOP_RECORDS     1   /* largest records, bytes */
+#define TOP_GAPS        2   /* longest gaps before a record, usec */
+#define TOP_WINDOWS     3   /* busiest TOP_WINDOW seconds of a file, bytes */
+#define TOP_KINDS       4
+#define TOP_WINDOW      1   /* seconds, from first record of file */
+#define TOP_MAX         1000
+
+typedef struct TOPENTRY
+{
+    long long value;
+    long long offset;       /* of record in file */
+    long long when;         /* sec from first record of file */
+    int file;               /* index in arguments */
+} Top_Entry;
+
+/* heaps of the largest ones of each kind, smallest at root */
+typedef struct TOP
+{
+    Top_Entry *heap[TOP_KINDS];
+    int count[TOP_KINDS];
+    int size;
+} Top;
+
+/* TOP_WINDOW seconds of a file, while being added up */
+typedef struct WINDOW
+{
+    long long index;        /* sec from first record / TOP_WINDOW */
+    long long bytes;
+    long long offset;       /* of first record in it */
+} Window;
+
+/* rows of export with -x as read by one thread, in a temporary file for
+    each column, written SPOOL_ROWS at a time. Files are read through by
+    one thread, so the rows of each are together. */
+#define SPOOL_ROWS      4096
+#define SPOOL_BUF       65536   /* payload is searched for CLRSCR this much at a time */
+
+typedef struct SPOOL
+{
+    FILE *col[TTYCOLS_COLUMNS];
+    unsigned char *batch[TTYCOLS_COLUMNS];
+    int batched;
+    long long rows;         /* including batched */
+    char buf[SPOOL_BUF];    /* for payload */
+} Spool;
+
+/* part of a file scanned by a thread of its own */
+typedef struct PART
+{
+    pthread_t thread;
     FILE *fp;
-    int i, j;
+    long to, end;           /* end is where scanning stopped */
+    long last_at;           /* offset of last record */
+    Header first, last;
+    Stats stats;            /* without first record */
+    Anomalies anomalies;    /* without time of first record */
+    Top *top;               /* NULL if not wanted */
+    Spool *spool;           /* NULL if not exported */
+    int file;
+    struct timeval file_start;  /* time of first record of file */
+    Window head, tail;      /* first and last window, added when stitching */
+    int windows;            /* count of windows, if 1 it is in tail */
+} Part;
 
-    fp = efopen(filename, "r");
+/* grouping of totals with -g */
+#define GROUP_OFF       0
+#define GROUP_REGEX     1   /* first capture of regex in path, or match */
+#define GROUP_DAY       2   /* local date of first record */
+#define GROUP_MONTH     3
+#define GROUP_KEY       256 /* longest key kept */
+#define GROUP_NONE      "-" /* key of files not in any group */
 
-    read_header(fp, &start);
-    curr = start;
-    fseek(fp, start.len, SEEK_CUR);
-    while (1)
+typedef struct GROUP
+{
+    char *key;
+    int files;
+    Stats stats;
+} Group;
+
+/* groups by key, in a hash table of open addressing */
+typedef struct GROUPS
+{
+    Group *groups;
+    int count;
+    int *slots;             /* index + 1 in groups, 0 if free */
+    int slot_count;         /* power of two, at least twice count */
+} Groups;
+
+/* what is printed of a file when all are done */
+typedef struct FILERESULT
+{
+    long long duration, records;
+    char cached, full;      /* full: read through in quick mode */
+    Anomalies *an;          /* NULL if none */
+    Spool *spool;           /* with rows exported, if any */
+    long long row, rows;    /* first in spool, and count */
+} File_Result;
+
+typedef struct CACHEENTRY
+{
+    unsigned long long dev, ino, size;
+    long long mtime;
+    long long start;        /* first record, for grouping by date */
+    Stats stats;
+    int used;               /* found or stored in this run */
+} Cache_Entry;
+
+typedef struct CACHE
+{
+    char *path;
+    Cache_Entry *entries;   /* sorted up to loaded, new ones after */
+    int count, alloc, loaded;
+    int hits, dirty;
+} Cache;
+
+/* files to analyze, shared by threads */
+typedef struct JOB
+{
+    pthread_mutex_t lock;   /* for next and cache */
+    int argc, next;
+    char **argv;
+    File_Result *results;
+    Cache *cache;
+    int quick, report;
+    int top;                /* size of top lists, 0 if none */
+    char *export;           /* path of columnar export, NULL if none */
+    int parts;              /* to read each file in */
+    int group;              /* GROUP_* */
+    regex_t regex;
+} Job;
+
+typedef struct WORKER
+{
+    pthread_t thread;
+    Job *job;
+    Stats total;
+    Groups groups;
+    Top *top;               /* NULL if no top lists */
+    Spool *spool;           /* NULL if no export */
+} Worker;
+
+static int threads = 1;    /* files, or parts of a large one, read at once */
+
+static int
+entry_cmp (const void *a, const void *b)
+{
+    const Cache_Entry *x = a, *y = b;
+
+    if (x->dev != y->dev)
+        return x->dev < y->dev ? -1 : 1;
+    return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+/* read cache at path; a missing or unreadable one is started afresh */
+Cache *cache_load(const char *path)
+{
+    Cache *c = emalloc(sizeof(Cache));
+    unsigned char hdr[CACHE_HEADER], buf[CACHE_ENTRY];
+    FILE *fp = fopen(path, "r");
+    int i, k;
+
+    memset(c, 0, sizeof(Cache));
+    c->path = strdup(path);
+    if (fp == NULL)
+        return c;
+    if (fread(hdr, 1, CACHE_HEADER, fp) != CACHE_HEADER || 
+        memcmp(hdr, CACHE_MAGIC, 8) != 0 || hdr[8] != CACHE_VERSION)
+    {
+        fprintf(stderr, "%s: %s: not a cache of this version, starting afresh\n",
+                get_progname(), path);
+        fclose(fp);
+        return c;
+    }
+    c->alloc = get_le(hdr + 12, 4) + 1;
+    c->entries = emalloc(c->alloc * sizeof(Cache_Entry));
+    while (c->count < c->alloc - 1 && fread(buf, 1, CACHE_ENTRY, fp) == CACHE_ENTRY)
+    {
+        Cache_Entry *e = &c->entries[c->count++];
+        unsigned char *p = buf + 56;
+
+        e->dev = get_le(buf, 8);
+        e->ino = get_le(buf + 8, 8);
+        e->size = get_le(buf + 16, 8);
+        e->mtime = get_le(buf + 24, 8);
+        e->stats.duration = get_le(buf + 32, 8);
+        e->stats.records = get_le(buf + 40, 8);
+        e->start = get_le(buf + 48, 8);
+        for (k = 0; k < LENGTH_BUCKETS; k++, p += 8)
+            e->stats.lengths[k] = get_le(p, 8);
+        for (k = 0; k < TIME_BUCKETS; k++, p += 8)
+            e->stats.times[k] = get_le(p, 8);
+        e->used = 0;
+    }
+    fclose(fp);
+    /* written sorted, but be sure, bsearch needs it */
+    for (i = 1; i < c->count && entry_cmp(&c->entries[i - 1], &c->entries[i]) < 0; i++)
+        ;
+    if (i < c->count)
+        qsort(c->entries, c->count, sizeof(Cache_Entry), entry_cmp);
+    c->loaded = c->count;
+    return c;
+}
+
+/* key of filename into e, 0 if it has none */
+int cache_key(const char *filename, Cache_Entry *e)
+{
+    struct stat st;
+
+    if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode))
+        return 0;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->size = st.st_size;
+    e->mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return 1;
+}
+
+/* loaded entry with same device and inode, NULL if none. Entries 
+    stored in this run are not looked at, a file given twice is read 
+    twice; cache_save() keeps one of them. */
+Cache_Entry *cache_find(Cache *c, const Cache_Entry *key)
+{
+    return bsearch(key, c->entries, c->loaded, sizeof(Cache_Entry), entry_cmp);
+}
+
+/* results of the file of key, in place of those it had, if any */
+void cache_store(Cache *c, const Cache_Entry *key, const Stats *stats)
+{
+    Cache_Entry *e = cache_find(c, key);
+
+    if (e == NULL)
+    {
+        if (c->count == c->alloc)
+        {
+            c->alloc = c->alloc ? c->alloc * 2 : 64;
+            c->entries = realloc(c->entries, c->alloc * sizeof(Cache_Entry));
+            if (c->entries == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        e = &c->entries[c->count++];
+    }
+    *e = *key;
+    e->stats = *stats;
+    e->used = 1;
+    c->dirty = 1;
+}
+
+/* write cache through a temporary file, so a crash leaves the old one.
+    Only entries used in this run are kept, the rest are of files gone,
+    changed or not asked for any more, and one of each file. */
+void cache_save(Cache *c)
+{
+    char *tmp = emalloc(strlen(c->path) + 5);
+    unsigned char buf[CACHE_ENTRY];
+    FILE *fp;
+    int i, k, n = 0;
+
+    for (i = 0; i < c->count; i++)
+    {
+        if (c->entries[i].used)
+            c->entries[n++] = c->entries[i];
+    }
+    if (n < c->count)
+        c->dirty = 1;
+    c->count = n;
+    qsort(c->entries, c->count, sizeof(Cache_Entry), entry_cmp);
+    for (i = n = 0; i < c->count; i++)
+    {
+        if (n == 0 || entry_cmp(&c->entries[n - 1], &c->entries[i]) != 0)
+            c->entries[n++] = c->entries[i];
+    }
+    c->count = n;
+    if (!c->dirty)
+    {
+        free(tmp);
+        return;
+    }
+    sprintf(tmp, "%s.tmp", c->path);
+    fp = efopen(tmp, "w");
+    memset(buf, 0, CACHE_HEADER);
+    memcpy(buf, CACHE_MAGIC, 8);
+    buf[8] = CACHE_VERSION;
+    put_le(buf + 12, c->count, 4);
+    fwrite(buf, 1, CACHE_HEADER, fp);
+    for (i = 0; i < c->count; i++)
+    {
+        Cache_Entry *e = &c->entries[i];
+        unsigned char *p = buf + 56;
+
+        put_le(buf, e->dev, 8);
+        put_le(buf + 8, e->ino, 8);
+        put_le(buf + 16, e->size, 8);
+        put_le(buf + 24, e->mtime, 8);
+        put_le(buf + 32, e->stats.duration, 8);
+        put_le(buf + 40, e->stats.records, 8);
+        put_le(buf + 48, e->start, 8);
+        for (k = 0; k < LENGTH_BUCKETS; k++, p += 8)
+            put_le(p, e->stats.lengths[k], 8);
+        for (k = 0; k < TIME_BUCKETS; k++, p += 8)
+            put_le(p, e->stats.times[k], 8);
+        fwrite(buf, 1, CACHE_ENTRY, fp);
+    }
+    if (ferror(fp) || fclose(fp) != 0 || rename(tmp, c->path) != 0)
+    {
+        perror(c->path);
+        unlink(tmp);
+    }
+    free(tmp);
+}
+
+void stats_add(Stats *total, const Stats *st)
+{
+    int k;
+
+    total->duration += st->duration;
+    total->records += st->records;
+    for (k = 0; k < LENGTH_BUCKETS; k++)
+        total->lengths[k] += st->lengths[k];
+    for (k = 0; k < TIME_BUCKETS; k++)
+        total->times[k] += st->times[k];
+}
+
+/* count record curr, which comes after prev, into st */
+static void
+add_record (Stats *st, const Header *prev, const Header *curr)
+{
+    long long i, j;
+
+    st->records++;
+    i = curr->tv.tv_sec - prev->tv.tv_sec;
+    if (i > 0)
+    {
+        i = log2(i);
+    }
+    else
+    {
+        i = 0;      /* back in time, counted as an anomaly */
+    }
+    st->times[i]++;
+    j = curr->len;
+    if (j > 0)
+    {
+        j = log2(j);
+    }
+    else
+    {
+        j = 0;      /* a negative one ends the scan before this */
+    }
+    st->lengths[j]++;
+}
+
+static void
+add_anomaly (Anomalies *an, long long offset, int kind, long long value)
+{
+    if (an->count < ANOMALY_KEEP)
+    {
+        an->list[an->count].offset = offset;
+        an->list[an->count].kind = kind;
+        an->list[an->count].value = value;
+    }
+    an->count++;
+}
+
+static long long
+usec_between (const Header *prev, const Header *curr)
+{
+    return (curr->tv.tv_sec - prev->tv.tv_sec) * 1000000LL + 
+           curr->tv.tv_usec - prev->tv.tv_usec;
+}
+
+/* anomalies of time of record at offset curr, which comes after prev */
+static void
+check_time (Anomalies *an, long long offset, const Header *prev, const Header *curr)
+{
+    long long us = usec_between(prev, curr);
+
+    if (us < 0)
+        add_anomaly(an, offset, ANOMALY_BACK, -us);
+    else if (us >= ANOMALY_GAP_SEC * 1000000LL)
+        add_anomaly(an, offset, ANOMALY_GAP, us);
+}
+
+/* top lists, cf. Top. Kept in bounded heaps, so any number of records
+    takes memory for only TOP_KINDS * size entries. */
+Top *top_new(int size)
+{
+    Top *t = emalloc(sizeof(Top));
+    int k;
+
+    for (k = 0; k < TOP_KINDS; k++)
+    {
+        t->heap[k] = emalloc(size * sizeof(Top_Entry));
+        t->count[k] = 0;
+    }
+    t->size = size;
+    return t;
+}
+
+void top_free(Top *t)
+{
+    int k;
+
+    for (k = 0; k < TOP_KINDS; k++)
+        free(t->heap[k]);
+    free(t);
+}
+
+/* whether a ranks below b; of equal values, the one in an earlier file
+    or earlier in the file ranks higher, so what is kept does not depend
+    on the order entries come in */
+static int
+top_below (const Top_Entry *a, const Top_Entry *b)
+{
+    if (a->value != b->value)
+        return a->value < b->value;
+    if (a->file != b->file)
+        return a->file > b->file;
+    return a->offset > b->offset;
+}
+
+/* keep e if it is among the largest of its kind */
+static void
+top_push (Top *t, int kind, const Top_Entry *e)
+{
+    Top_Entry *h = t->heap[kind];
+    int i, c, n = t->count[kind];
+
+    if (n < t->size)    /* up from the bottom */
     {
-        Header h;
-        if (read_header(fp, &h) == 0)
+        for (i = n; i > 0 && top_below(e, &h[(i - 1) / 2]); i = (i - 1) / 2)
+            h[i] = h[(i - 1) / 2];
+        h[i] = *e;
+        t->count[kind]++;
+        return;
+    }
+    if (!top_below(&h[0], e))
+        return;
+    for (i = 0; (c = 2 * i + 1) < n; i = c)     /* down from the root */
+    {
+        if (c + 1 < n && top_below(&h[c + 1], &h[c]))
+            c++;
+        if (!top_below(&h[c], e))
+            break;
+        h[i] = h[c];
+    }
+    h[i] = *e;
+}
+
+static void
+top_add (Top *t, int kind, long long value, long long offset, long long when, int file)
+{
+    Top_Entry e;
+
+    e.value = value;
+    e.offset = offset;
+    e.when = when;
+    e.file = file;
+    top_push(t, kind, &e);
+}
+
+/* push all of src to t, and free src */
+void top_merge(Top *t, Top *src)
+{
+    int k, i;
+
+    for (k = 0; k < TOP_KINDS; k++)
+        for (i = 0; i < src->count[k]; i++)
+            top_push(t, k, &src->heap[k][i]);
+    top_free(src);
+}
+
+static void
+top_window (Top *t, const Window *w, int file)
+{
+    top_add(t, TOP_WINDOWS, w->bytes, w->offset, w->index * TOP_WINDOW, file);
+}
+
+/* add record at offset to windows of part; all but its first and last
+    are complete, and go to the top list right away */
+static void
+part_window (Part *p, long long offset, const Header *h)
+{
+    long long index = (h->tv.tv_sec - p->file_start.tv_sec) / TOP_WINDOW;
+
+    if (p->windows > 0 && index == p->tail.index)
+    {
+        p->tail.bytes += h->len;
+        return;
+    }
+    if (p->windows == 1)
+        p->head = p->tail;
+    else if (p->windows > 1)
+        top_window(p->top, &p->tail, p->file);
+    p->tail.index = index;
+    p->tail.bytes = h->len;
+    p->tail.offset = offset;
+    p->windows++;
+}
+
+/* columns of export, cf. TTYCOLS in ttyrec.h */
+static const struct
+{
+    const char *name;
+    char type;
+    int size;
+} columns[TTYCOLS_COLUMNS] = {
+    { "file", 'u', 4 },
+    { "offset", 'u', 8 },
+    { "time", 'i', 8 },
+    { "length", 'u', 8 },
+    { "clrscr", 'u', 1 },
+};
+
+Spool *spool_new(void)
+{
+    Spool *s = emalloc(sizeof(Spool));
+    int c;
+
+    memset(s, 0, sizeof(Spool));
+    for (c = 0; c < TTYCOLS_COLUMNS; c++)
+    {
+        if ((s->col[c] = tmpfile()) == NULL)
+        {
+            perror("tmpfile");
+            exit(EXIT_FAILURE);
+        }
+        s->batch[c] = emalloc(SPOOL_ROWS * columns[c].size);
+    }
+    return s;
+}
+
+void spool_flush(Spool *s)
+{
+    int c;
+
+    for (c = 0; c < TTYCOLS_COLUMNS; c++)
+        if (fwrite(s->batch[c], columns[c].size, s->batched, s->col[c]) != s->batched)
         {
+            perror("spool");
+            exit(EXIT_FAILURE);
+        }
+    s->batched = 0;
+}
+
+void spool_free(Spool *s)
+{
+    int c;
+
+    for (c = 0; c < TTYCOLS_COLUMNS; c++)
+    {
+        fclose(s->col[c]);
+        free(s->batch[c]);
+    }
+    free(s);
+}
+
+static void
+spool_add (Spool *s, int file, long long offset, const Header *h, int clrscr)
+{
+    int i = s->batched++;
+
+    put_le(s->batch[TTYCOLS_FILE] + 4 * i, file, 4);
+    put_le(s->batch[TTYCOLS_OFFSET] + 8 * i, offset, 8);
+    put_le(s->batch[TTYCOLS_TIME] + 8 * i, h->tv.tv_sec * 1000000LL + h->tv.tv_usec, 8);
+    put_le(s->batch[TTYCOLS_LENGTH] + 8 * i, h->len, 8);
+    s->batch[TTYCOLS_CLRSCR][i] = clrscr;
+    s->rows++;
+    if (s->batched == SPOOL_ROWS)
+        spool_flush(s);
+}
+
+/* read payload of h from fp to spool it with CLRSCR flag. Leaves fp
+    where seeking past the payload would, even if it is cut short. */
+static void
+spool_record (Spool *s, FILE *fp, int file, long long offset, const Header *h)
+{
+    long long left = h->len;
+    size_t keep = 0, n, got;
+    int clrscr = 0;
+
+    /* in chunks, as the length may be corrupt; the end of each chunk is
+        kept for a CLRSCR across two */
+    while (left > 0 && !clrscr)
+    {
+        n = left < SPOOL_BUF - keep ? left : SPOOL_BUF - keep;
+        got = fread(s->buf + keep, 1, n, fp);
+        left -= got;
+        clrscr = memmem(s->buf, keep + got, CLRSCR, strlen(CLRSCR)) != NULL;
+        if (got < n)
             break;
+        n = keep + got;
+        keep = n < strlen(CLRSCR) - 1 ? n : strlen(CLRSCR) - 1;
+        memmove(s->buf, s->buf + n - keep, keep);
+    }
+    if (left > 0)
+        fseek(fp, left, SEEK_CUR);
+    spool_add(s, file, offset, h, clrscr);
+}
+
+/* scan one part of a file, cf. ttysplit(). The first record of a part 
+    is only counted when parts are stitched, as its time is counted from
+    the last one of the part before. */
+static void *
+scan_part (void *arg)
+{
+    Part *p = arg;
+    Header h;
+    long at;
+    int have = 0;
+
+    /* a negative length is no record, and the file is cut there, as 
+        reported by -a */
+    while ((at = ftell(p->fp)) < p->to && read_header(p->fp, &h) && h.len >= 0)
+    {
+        if (have)
+        {
+            add_record(&p->stats, &p->last, &h);
+            check_time(&p->anomalies, at, &p->last, &h);
+        }
+        else
+            p->first = h;
+        if (h.len >= ANOMALY_LEN_MAX)
+            add_anomaly(&p->anomalies, at, ANOMALY_LEN, h.len);
+        if (p->top)
+        {
+            long long when = h.tv.tv_sec - p->file_start.tv_sec;
+
+            top_add(p->top, TOP_RECORDS, h.len, at, when, p->file);
+            if (have)
+                top_add(p->top, TOP_GAPS, usec_between(&p->last, &h), at, when, p->file);
+            part_window(p, at, &h);
         }
-        end = h;
+        have = 1;
+        p->last = h;
+        p->last_at = at;
+        if (p->spool)
+            spool_record(p->spool, p->fp, p->file - optind, at, &h);  /* ids from 0 */
+        else
+            fseek(p->fp, h.len, SEEK_CUR);
+    }
+    p->end = at;    /* not after a header cut short */
+    return NULL;
+}
+
+/* add anomalies of src after those in an */
+static void
+anomalies_add (Anomalies *an, const Anomalies *src)
+{
+    long long i;
+
+    for (i = 0; i < src->count && i < ANOMALY_KEEP; i++)
+        add_anomaly(an, src->list[i].offset, src->list[i].kind, src->list[i].value);
+    if (src->count > ANOMALY_KEEP)
+        an->count += src->count - ANOMALY_KEEP;
+}
 
-        prev = curr;
-        curr = h;
+/* scan filename in up to parts parts at once, adding counts to total, 
+    if an is not NULL, anomalies to it, and if top is not NULL, records,
+    gaps and windows to it as of file. If spool is not NULL, the file is
+    read in one part, with rows of its records added to spool. If start
+    is not NULL, seconds of the first record go there, -1 if none. 
+    Returns duration. */
+long long calc_time(const char *filename, int parts, Stats *total, Anomalies *an,
+                    Top *top, Spool *spool, int file, long long *start)
+{
+    FILE *fp[MAX_THREADS];
+    long from[MAX_THREADS + 1], end;
+    Part part[MAX_THREADS];
+    Anomalies found;
+    Window open;
+    Header first;
+    Stats st;
+    int k, n = ttysplit(filename, spool ? 1 : parts, fp, from);
 
-        (*records)++;
-        i = curr.tv.tv_sec - prev.tv.tv_sec;
-        if (i > 0)
+    first.tv.tv_sec = 0;
+    if (start)
+        *start = read_header(fp[0], &first) ? first.tv.tv_sec : -1;
+    else
+        read_header(fp[0], &first);
+    fseek(fp[0], from[0], SEEK_SET);
+    memset(part, 0, n * sizeof(Part));
+    for (k = 0; k < n; k++)
+    {
+        part[k].fp = fp[k];
+        part[k].to = from[k + 1];
+        part[k].file = file;
+        part[k].file_start = first.tv;
+        part[k].top = top ? top_new(top->size) : NULL;
+        part[k].spool = spool;
+        if (k > 0 && pthread_create(&part[k].thread, NULL, scan_part, &part[k]) != 0)
         {
-            i = log2(i);
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
         }
-        times[i]++;
-        j = curr.len;
-        if (j > 0)
+    }
+    scan_part(&part[0]);
+    for (k = 1; k < n; k++)
+        pthread_join(part[k].thread, NULL);
+    end = ttydataend(fp[0]);
+    for (k = 0; k < n; k++)
+        ttyclose(fp[k]);
+
+    /* stitch parts, each must end where the next starts and have a
+        record */
+    st = part[0].stats;
+    found = part[0].anomalies;
+    for (k = 1; k < n && part[k - 1].end == from[k] && part[k].end > from[k]; k++)
+    {
+        add_record(&st, &part[k - 1].last, &part[k].first);
+        stats_add(&st, &part[k].stats);
+        if (an)
         {
-            j = log2(j);
+            check_time(&found, from[k], &part[k - 1].last, &part[k].first);
+            anomalies_add(&found, &part[k].anomalies);
         }
-        lengths[j]++;
+    }
+    if (k < n)      /* a part started within a record after all */
+    {
+        for (k = 0; k < n; k++)
+            if (part[k].top)
+                top_free(part[k].top);
+        return calc_time(filename, 1, total, an, top, spool, file, start);
+    }
+    if (an)
+    {
+        if (part[n - 1].end > end)
+            add_anomaly(&found, part[n - 1].last_at, ANOMALY_CUT, part[n - 1].end - end);
+        else if (part[n - 1].end < end)
+            add_anomaly(&found, part[n - 1].end, ANOMALY_TAIL, end - part[n - 1].end);
+        anomalies_add(an, &found);
+    }
+    if (top)    /* windows where parts meet may be in both */
+    {
+        int have_open = 0;
 
-        fseek(fp, h.len, SEEK_CUR);
+        for (k = 0; k < n; k++)
+        {
+            top_merge(top, part[k].top);
+            if (part[k].windows == 0)
+                continue;
+            if (k > 0)
+                top_add(top, TOP_GAPS, usec_between(&part[k - 1].last, &part[k].first),
+                        from[k], part[k].first.tv.tv_sec - first.tv.tv_sec, file);
+            if (part[k].windows > 1 && have_open && open.index == part[k].head.index)
+                open.bytes += part[k].head.bytes;
+            else if (part[k].windows == 1 && have_open && open.index == part[k].tail.index)
+                open.bytes += part[k].tail.bytes;
+            else
+            {
+                if (have_open)
+                    top_window(top, &open, file);
+                open = part[k].windows > 1 ? part[k].head : part[k].tail;
+                have_open = 1;
+            }
+            if (part[k].windows > 1)
+            {
+                top_window(top, &open, file);
+                open = part[k].tail;
+            }
+        }
+        if (have_open)
+            top_window(top, &open, file);
     }
-    return end.tv.tv_sec - start.tv.tv_sec;
+    stats_add(total, &st);
+    return part[n - 1].last.tv.tv_sec - part[0].first.tv.tv_sec;
 }
 
-int main(int argc, char **argv)
+/* duration from the first and last header only, if that works out, 
+    else by reading the file through; seconds of the first record to 
+    start, -1 if none. returns 1 if it worked out */
+int quick_time(const char *filename, int parts, long long *duration, long long *start)
+{
+    Header first, last;
+    FILE *fp = ttyopen(filename);
+    int have_first = read_header(fp, &first);
+    int quick = have_first && read_last_header(fp, &first, &last);
+    Stats st;
+
+    ttyclose(fp);
+    *start = have_first ? first.tv.tv_sec : -1;
+    if (quick)
+        *duration = last.tv.tv_sec - first.tv.tv_sec;
+    else
+    {
+        memset(&st, 0, sizeof(st));
+        *duration = calc_time(filename, parts, &st, NULL, NULL, NULL, 0, NULL);
+    }
+    return quick;
+}
+
+/* proportion of bucket k over chunks, as a ratio estimate with clusters
+    of sizes m[], and its variance */
+static double
+ratio_var (const long long *y, const long long *m, int chunks, double *p)
 {
+    double sy = 0, sm = 0, ss = 0;
     int i;
-    int lengths[20], times[30];
-    set_progname(argv[0]);
 
-    if (argc == 1)
+    for (i = 0; i < chunks; i++)
     {
-        char *pgmname = strdup(argv[0]);
-        printf("Usage: %s file [file]...\n", basename(pgmname));
-        exit(1);
+        sy += y[i];
+        sm += m[i];
     }
+    *p = sm > 0 ? sy / sm : 0;
+    for (i = 0; i < chunks; i++)
+        ss += (y[i] - *p * m[i]) * (y[i] - *p * m[i]);
+    if (sm == 0)
+        return 0;
+    return ss / (chunks * (chunks - 1.0)) / ((sm / chunks) * (sm / chunks));
+}
 
-    for (i = 20; i; lengths[--i] = 0)
-        ;
-    for (i = 30; i; times[--i] = 0)
-        ;
+/* add estimate of bucket counts over chunks to est[k] and var[k] */
+static void
+estimate_buckets (Stats *chunk, const long long *m, int chunks, int buckets, 
+                  int times, double n, double var_n, double *est, double *var)
+{
+    long long *y = emalloc(chunks * sizeof(long long));
+    double p, var_p;
+    int i, k;
 
-    printf("Replay time of file(s) (sec, HH:mm:ss) and number of records:\n");
-    int total_seconds=0;
-    for (i = 1; i < argc; i++)
+    for (k = 0; k < buckets; k++)
     {
-        char *filename = argv[i];
-        int records = 0;
+        for (i = 0; i < chunks; i++)
+            y[i] = times ? chunk[i].times[k] : chunk[i].lengths[k];
+        var_p = ratio_var(y, m, chunks, &p);
+        est[k] += n * p;
+        var[k] += n * n * var_p + p * p * var_n;
+    }
+    free(y);
+}
 
-        int duration = calc_time(filename, times, lengths, &records);
-        int hrs = (int)duration / 3600;
-        int min = (int)(duration - hrs * 3600) / 60;
-        int sec = duration - hrs * 3600 - min * 60;
-        printf("(%7d	%d:%02d:%02d) %d %s\n", duration, hrs, min, sec, records, filename);
-        total_seconds += duration;
+/* estimate records and distributions of filename from chunks of records
+    at random places and add them to est, reading the file through if it
+    is small or chunks cannot be found. Returns estimated records. */
+double sample_file(const char *filename, int chunks, Estimate *est)
+{
+    FILE *fp = ttyopen(filename);
+    Header first, last, prev, h;
+    Stats *chunk = emalloc(chunks * sizeof(Stats));
+    long long *bytes = emalloc(chunks * sizeof(long long));
+    long long *m = emalloc(chunks * sizeof(long long));
+    long long *gaps = emalloc(chunks * sizeof(long long));
+    long start = ftell(fp), size = -1, end;
+    double r, var_r, n = 0, var_n;
+    int i, k, found = 0;
+
+    if (read_header(fp, &first) && fseek(fp, 0, SEEK_END) == 0)
+        size = ftell(fp);
+    if (size - start > SAMPLE_FULL && read_last_header(fp, &first, &last))
+    {
+        end = ftell(fp);    /* of records, before any footer */
+        memset(chunk, 0, chunks * sizeof(Stats));
+        for (i = 0; i < chunks; i++)
+        {
+            long at = -1;
+
+            /* one chunk in each of as many strata, for an even spread; 
+                past the last record start there is none to be found */
+            for (k = 0; k < SAMPLE_TRIES && at < 0; k++)
+                at = ttyresync(fp, start + (end - start) * ((i + drand48()) / chunks), 
+                               &first);
+            if (at < 0)
+                continue;
+            for (k = 0; k < SAMPLE_RECORDS && read_header(fp, &h) && h.len >= 0; k++)
+            {
+                long long j = h.len > 0 ? log2(h.len) : 0;
+
+                chunk[found].lengths[j]++;
+                if (k > 0)
+                {
+                    j = h.tv.tv_sec - prev.tv.tv_sec;
+                    chunk[found].times[j > 0 ? (int) log2(j) : 0]++;
+                }
+                prev = h;
+                fseek(fp, h.len, SEEK_CUR);
+            }
+            m[found] = k;
+            gaps[found] = k - 1;
+            bytes[found] = ftell(fp) - at;
+            if (k > 1)
+                found++;
+            else
+                memset(&chunk[found], 0, sizeof(Stats));
+        }
+    }
+    if (found > 1)
+    {
+        var_r = ratio_var(bytes, m, found, &r);
+        n = (end - start) / r;
+        var_n = n * n * var_r / (r * r);
+        estimate_buckets(chunk, m, found, LENGTH_BUCKETS, 0, n, var_n, 
+                         est->lengths, est->var_lengths);
+        estimate_buckets(chunk, gaps, found, TIME_BUCKETS, 1, n, var_n, 
+                         est->times, est->var_times);
+        est->records += n;
+        est->var_records += var_n;
+        est->duration += last.tv.tv_sec - first.tv.tv_sec;
+        for (i = 0; i < found; i++)
+            est->sampled += bytes[i];
     }
-    printf("%d file(s) analyzed.\n\n", argc-1);
+    ttyclose(fp);
+    if (found < 2)      /* read through, exactly */
+    {
+        Stats st;
 
+        memset(&st, 0, sizeof(st));
+        st.duration = calc_time(filename, 1, &st, NULL, NULL, NULL, 0, NULL);
+        for (k = 0; k < LENGTH_BUCKETS; k++)
+            est->lengths[k] += st.lengths[k];
+        for (k = 0; k < TIME_BUCKETS; k++)
+            est->times[k] += st.times[k];
+        est->records += n = st.records;
+        est->duration += st.duration;
+        est->sampled += size > start ? size - start : 0;
+    }
+    est->bytes += size > start ? size - start : 0;
+    free(chunk);
+    free(bytes);
+    free(m);
+    free(gaps);
+    return n;
+}
+
+/* print estimate of bucket counts with their confidence intervals */
+void print_estimates(const double *est, const double *var, int buckets)
+{
     int j;
 
+    for (j = 0; j < buckets; j++)
+    {
+        if (est[j] >= 0.5)
+            printf("< %.0f\t(2^%d)\t%.0f\t+- %.0f\n", pow(2, j), j, est[j], 
+                   SAMPLE_Z * sqrt(var[j]));
+    }
+}
+
+/* report estimates for files from argv[optind] on, chunks per file */
+void estimate_files(int argc, char **argv, int chunks)
+{
+    Estimate est;
+    int i;
+
+    memset(&est, 0, sizeof(est));
+    srand48(SAMPLE_SEED);   /* same sample for same files */
+    argc = pack_expand_args(argc, argv, optind, &argv);
+    printf("Replay time of file(s) (sec, HH:mm:ss) and estimated number of records:\n");
+    for (i = optind; i < argc; i++)
+    {
+        long long duration = est.duration;
+        double n = sample_file(argv[i], chunks, &est);
+
+        duration = est.duration - duration;
+        long long hrs = duration / 3600;
+        int min = (duration - hrs * 3600) / 60;
+        int sec = duration - hrs * 3600 - min * 60;
+        printf("(%7lld	%lld:%02d:%02d) %.0f %s\n", duration, hrs, min, sec, n, argv[i]);
+    }
+    printf("%d file(s) analyzed, %lld of %lld bytes read (%.1f%%).\n\n", argc - optind, 
+           est.sampled, est.bytes, est.bytes ? 100.0 * est.sampled / est.bytes : 100.0);
+
+    printf("Length distribution of screen updates, estimated with 95%% confidence:\n");
+    print_estimates(est.lengths, est.var_lengths, LENGTH_BUCKETS);
+    printf("Estimated records: %.0f +- %.0f\n", est.records, SAMPLE_Z * sqrt(est.var_records));
+    printf("Duration distribution of actions, sec, estimated with 95%% confidence:\n");
+    print_estimates(est.times, est.var_times, TIME_BUCKETS);
+    printf("Total time: %lld sec.\n", est.duration);
+    if (est.records >= 1)
+        printf("Average of action durations: %1.2f sec (estimated)\n", est.duration / est.records);
+}
+
+void partial_write(const char *path, const Stats *total, int files)
+{
+    unsigned char buf[PART_SIZE], *p = buf + PART_HEADER + 16;
+    FILE *fp = efopen(path, "w");
+    int k;
+
+    memset(buf, 0, PART_HEADER);
+    memcpy(buf, PART_MAGIC, 8);
+    buf[8] = PART_VERSION;
+    put_le(buf + 12, files, 4);
+    put_le(buf + PART_HEADER, total->duration, 8);
+    put_le(buf + PART_HEADER + 8, total->records, 8);
+    for (k = 0; k < LENGTH_BUCKETS; k++, p += 8)
+        put_le(p, total->lengths[k], 8);
+    for (k = 0; k < TIME_BUCKETS; k++, p += 8)
+        put_le(p, total->times[k], 8);
+    if (fwrite(buf, 1, PART_SIZE, fp) != PART_SIZE)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    efclose(fp);
+}
+
+/* add partial results at path to total, returns count of files in it */
+int partial_read(const char *path, Stats *total)
+{
+    unsigned char buf[PART_SIZE], *p = buf + PART_HEADER + 16;
+    FILE *fp = efopen(path, "r");
+    Stats st;
+    int k;
+
+    if (fread(buf, 1, PART_SIZE, fp) != PART_SIZE || 
+        memcmp(buf, PART_MAGIC, 8) != 0 || buf[8] != PART_VERSION)
+    {
+        fprintf(stderr, "%s: %s: not partial results of this version\n", 
+                get_progname(), path);
+        exit(EXIT_FAILURE);
+    }
+    efclose(fp);
+    st.duration = get_le(buf + PART_HEADER, 8);
+    st.records = get_le(buf + PART_HEADER + 8, 8);
+    for (k = 0; k < LENGTH_BUCKETS; k++, p += 8)
+        st.lengths[k] = get_le(p, 8);
+    for (k = 0; k < TIME_BUCKETS; k++, p += 8)
+        st.times[k] = get_le(p, 8);
+    stats_add(total, &st);
+    return get_le(buf + 12, 4);
+}
+
+void print_anomalies(const Anomalies *an)
+{
+    long long i;
+
+    for (i = 0; i < an->count && i < ANOMALY_KEEP; i++)
+    {
+        const Anomaly *a = &an->list[i];
+
+        printf("    at %lld: ", a->offset);
+        switch (a->kind)
+        {
+        case ANOMALY_BACK:
+            printf("time goes back %lld.%06lld sec\n", a->value / 1000000, a->value % 1000000);
+            break;
+        case ANOMALY_GAP:
+            printf("gap of %lld.%06lld sec\n", a->value / 1000000, a->value % 1000000);
+            break;
+        case ANOMALY_LEN:
+            printf("record of %lld bytes\n", a->value);
+            break;
+        case ANOMALY_CUT:
+            printf("last record cut short by %lld bytes\n", a->value);
+            break;
+        case ANOMALY_TAIL:
+            printf("%lld bytes after last record are no record\n", a->value);
+            break;
+        }
+    }
+    if (an->count > ANOMALY_KEEP)
+        printf("    and %lld more\n", an->count - ANOMALY_KEEP);
+}
+
+/* key of group filename belongs to, in buf of size GROUP_KEY */
+void group_key(const Job *job, const char *filename, long long start, char *buf)
+{
+    regmatch_t m[2];
+
+    strcpy(buf, GROUP_NONE);
+    if (job->group == GROUP_REGEX)
+    {
+        if (regexec(&job->regex, filename, 2, m, 0) != 0)
+            return;
+        if (m[1].rm_so < 0)     /* no capture, whole match then */
+            m[1] = m[0];
+        snprintf(buf, GROUP_KEY, "%.*s", (int) (m[1].rm_eo - m[1].rm_so), 
+                 filename + m[1].rm_so);
+    }
+    else if ((job->group == GROUP_DAY || job->group == GROUP_MONTH) && start >= 0)
+    {
+        struct tm tm;
+        time_t t = start;
+
+        strftime(buf, GROUP_KEY, job->group == GROUP_DAY ? "%Y-%m-%d" : "%Y-%m", 
+                 localtime_r(&t, &tm));
+    }
+}
+
+static unsigned int
+group_hash (const char *key)
+{
+    unsigned int h = 2166136261u;   /* FNV-1a */
+
+    while (*key)
+        h = (h ^ (unsigned char) *key++) * 16777619u;
+    return h;
+}
+
+/* group of key in g, added if not there yet */
+Group *group_find(Groups *g, const char *key)
+{
+    unsigned int i;
+
+    if (2 * (g->count + 1) > g->slot_count)   /* grow, and rehash */
+    {
+        int k, n = g->slot_count ? 2 * g->slot_count : 64;
+
+        free(g->slots);
+        g->slots = emalloc(n * sizeof(int));
+        memset(g->slots, 0, n * sizeof(int));
+        g->slot_count = n;
+        for (k = 0; k < g->count; k++)
+        {
+            for (i = group_hash(g->groups[k].key) & (n - 1); g->slots[i]; i = (i + 1) & (n - 1))
+                ;
+            g->slots[i] = k + 1;
+        }
+        g->groups = realloc(g->groups, n / 2 * sizeof(Group));
+        assert(g->groups != NULL);
+    }
+    for (i = group_hash(key) & (g->slot_count - 1); g->slots[i]; 
+         i = (i + 1) & (g->slot_count - 1))
+    {
+        if (strcmp(g->groups[g->slots[i] - 1].key, key) == 0)
+            return &g->groups[g->slots[i] - 1];
+    }
+    g->slots[i] = g->count + 1;
+    memset(&g->groups[g->count], 0, sizeof(Group));
+    g->groups[g->count].key = strdup(key);
+    return &g->groups[g->count++];
+}
+
+void groups_merge(Groups *g, Groups *src)
+{
+    int k;
+
+    for (k = 0; k < src->count; k++)
+    {
+        Group *to = group_find(g, src->groups[k].key);
+
+        to->files += src->groups[k].files;
+        stats_add(&to->stats, &src->groups[k].stats);
+        free(src->groups[k].key);
+    }
+    free(src->groups);
+    free(src->slots);
+}
+
+static int
+group_cmp (const void *a, const void *b)
+{
+    return strcmp(((const Group *) a)->key, ((const Group *) b)->key);
+}
+
+/* print log2 buckets on one line, as 2^k:count */
+void print_buckets(const char *name, const long long *count, int buckets)
+{
+    int k;
+
+    printf("    %s", name);
+    for (k = 0; k < buckets; k++)
+    {
+        if (count[k])
+            printf(" 2^%d:%lld", k, count[k]);
+    }
+    putchar('\n');
+}
+
+void print_groups(Groups *g, int quick)
+{
+    int k;
+
+    qsort(g->groups, g->count, sizeof(Group), group_cmp);
+    printf("Totals by group (files, records, sec, HH:mm:ss, group):\n");
+    for (k = 0; k < g->count; k++)
+    {
+        Stats *st = &g->groups[k].stats;
+        long long hrs = st->duration / 3600;
+        int min = (st->duration - hrs * 3600) / 60;
+        int sec = st->duration - hrs * 3600 - min * 60;
+
+        if (quick)
+            printf("%5d\t-\t%7lld\t%lld:%02d:%02d\t%s\n", g->groups[k].files, 
+                   st->duration, hrs, min, sec, g->groups[k].key);
+        else
+        {
+            printf("%5d\t%lld\t%7lld\t%lld:%02d:%02d\t%s\n", g->groups[k].files, 
+                   st->records, st->duration, hrs, min, sec, g->groups[k].key);
+            print_buckets("lengths", st->lengths, LENGTH_BUCKETS);
+            print_buckets("times  ", st->times, TIME_BUCKETS);
+        }
+    }
+    putchar('\n');
+}
+
+/* copy rows of column c from spool to fp */
+static void
+spool_copy (Spool *s, int c, long long row, long long rows, FILE *fp)
+{
+    char buf[65536];
+    long long left = rows * columns[c].size;
+    size_t n;
+
+    fseeko(s->col[c], row * columns[c].size, SEEK_SET);
+    for (; left > 0; left -= n)
+    {
+        n = left < sizeof(buf) ? left : sizeof(buf);
+        if (fread(buf, 1, n, s->col[c]) != n || fwrite(buf, 1, n, fp) != n)
+        {
+            perror("export");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/* write rows of files of job, spooled by threads, to path in columns, 
+    cf. TTYCOLS in ttyrec.h. File ids are from 0 in order of arguments. */
+void export_write(const char *path, Job *job, int files)
+{
+    unsigned char head[TTYCOLS_HEADER + TTYCOLS_COLUMNS * TTYCOLS_COLUMN], *d;
+    long long rows = 0, at, offset[TTYCOLS_COLUMNS];
+    FILE *fp = efopen(path, "w");
+    int i, c;
+
+    for (i = optind; i < job->argc; i++)
+        rows += job->results[i].rows;
+    memset(head, 0, sizeof(head));
+    memcpy(head, TTYCOLS_MAGIC, 8);
+    head[8] = TTYCOLS_VERSION;
+    put_le(head + 12, TTYCOLS_COLUMNS, 4);
+    put_le(head + 16, rows, 8);
+    put_le(head + 24, files, 4);
+    at = sizeof(head);
+    for (c = 0, d = head + TTYCOLS_HEADER; c < TTYCOLS_COLUMNS; c++, d += TTYCOLS_COLUMN)
+    {
+        offset[c] = at = (at + 7) & ~7LL;
+        strncpy((char *)d, columns[c].name, TTYCOLS_NAME);
+        d[TTYCOLS_NAME] = columns[c].type;
+        d[TTYCOLS_NAME + 1] = columns[c].size;
+        put_le(d + TTYCOLS_NAME + 8, at, 8);
+        at += rows * columns[c].size;
+    }
+    put_le(head + 32, at, 8);     /* names */
+    if (fwrite(head, 1, sizeof(head), fp) != sizeof(head))
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    for (c = 0; c < TTYCOLS_COLUMNS; c++)
+    {
+        while (ftello(fp) < offset[c])
+            putc(0, fp);
+        for (i = optind; i < job->argc; i++)
+            if (job->results[i].rows > 0)
+                spool_copy(job->results[i].spool, c, job->results[i].row, 
+                           job->results[i].rows, fp);
+    }
+    for (i = optind; i < job->argc; i++)
+        fwrite(job->argv[i], 1, strlen(job->argv[i]) + 1, fp);
+    if (ferror(fp))
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    efclose(fp);
+}
+
+static int
+top_cmp (const void *a, const void *b)
+{
+    return top_below(b, a) ? -1 : top_below(a, b);
+}
+
+/* print top lists of t, largest first, with names of files from argv */
+void print_tops(Top *t, char **argv)
+{
+    static const char *title[TOP_KINDS] = {
+        "Longest files, sec:",
+        "Largest records, bytes:",
+        "Longest gaps between records, sec:",
+        "Busiest windows of %d sec, bytes:",
+    };
+    int k, i;
+
+    for (k = 0; k < TOP_KINDS; k++)
+    {
+        Top_Entry *h = t->heap[k];
+
+        printf(title[k], TOP_WINDOW);
+        putchar('\n');
+        qsort(h, t->count[k], sizeof(Top_Entry), top_cmp);
+        for (i = 0; i < t->count[k]; i++)
+        {
+            if (k == TOP_FILES)
+                printf("%7lld", h[i].value);
+            else if (k == TOP_GAPS)
+                printf("%14.6f", h[i].value / 1e6);
+            else
+                printf("%10lld", h[i].value);
+            if (k != TOP_FILES)
+                printf(" at %lld (+%lld sec)", h[i].offset, h[i].when);
+            printf(" %s\n", argv[h[i].file]);
+        }
+    }
+    putchar('\n');
+}
+
+/* analyze file i of job into its result, the totals and groups of w */
+void analyze_one(Job *job, int i, Worker *w)
+{
+    char *filename = job->argv[i];
+    File_Result *r = &job->results[i];
+    Cache_Entry key, *cached = NULL;
+    int have_key = job->cache && cache_key(filename, &key);
+    Anomalies an;
+    Stats st;
+    long long start = -1;
+
+    an.count = 0;
+    if (have_key && !job->report && !job->top && !job->export)
+    {
+        pthread_mutex_lock(&job->lock);
+        cached = cache_find(job->cache, &key);
+        if (cached && (cached->size != key.size || cached->mtime != key.mtime))
+            cached = NULL;      /* changed since */
+        if (cached)
+        {
+            st = cached->stats;
+            start = cached->start;
+            cached->used = 1;
+            job->cache->hits++;
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+    if (cached)
+        r->cached = 1;
+    else if (job->quick)
+    {
+        memset(&st, 0, sizeof(st));
+        r->full = !quick_time(filename, job->parts, &st.duration, &start);
+    }
+    else
+    {
+        memset(&st, 0, sizeof(st));
+        r->spool = w->spool;
+        r->row = w->spool ? w->spool->rows : 0;
+        st.duration = calc_time(filename, job->parts, &st, job->report ? &an : NULL,
+                                w->top, w->spool, i, &start);
+        r->rows = w->spool ? w->spool->rows - r->row : 0;
+        if (have_key)   /* as before reading, a change meanwhile shows */
+        {
+            key.start = start;
+            pthread_mutex_lock(&job->lock);
+            cache_store(job->cache, &key, &st);
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    r->duration = st.duration;
+    r->records = st.records;
+    if (an.count > 0)
+    {
+        r->an = emalloc(sizeof(Anomalies));
+        *r->an = an;
+    }
+    stats_add(&w->total, &st);
+    if (w->top)
+        top_add(w->top, TOP_FILES, st.duration, 0, 0, i);
+    if (job->group != GROUP_OFF)
+    {
+        char buf[GROUP_KEY];
+        Group *g;
+
+        group_key(job, filename, start, buf);
+        g = group_find(&w->groups, buf);
+        g->files++;
+        stats_add(&g->stats, &st);
+    }
+}
+
+/* take files of job one at a time until there are none left */
+static void *
+analyze_worker (void *arg)
+{
+    Worker *w = arg;
+    Job *job = w->job;
+    int i;
+
+    while (1)
+    {
+        pthread_mutex_lock(&job->lock);
+        i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->argc)
+            break;
+        analyze_one(job, i, w);
+    }
+    return NULL;
+}
+
+/* print per file results of files from argv[optind] on, and add them
+    to total. Returns count of files. Files are analyzed by up to as many
+    threads at once as asked for, each with totals of its own, merged 
+    here; results are printed in order when all are done. If quick, only
+    durations are found out, as cheaply as possible. If job->report, 
+    anomalies are reported for each file, if job->top, top lists of all,
+    and if job->export, all headers are written to it; files are then 
+    read even if cached. */
+int analyze_files(int argc, char **argv, Job *job, Stats *total)
+{
+    Worker worker[MAX_THREADS];
+    Groups groups;
+    int i, k, n, files, full = 0, bad = 0;
+    long long anomalies = 0;
+
+    argc = pack_expand_args(argc, argv, optind, &argv);   /* packs to members */
+    files = argc - optind;
+    job->argc = argc;
+    job->argv = argv;
+    job->next = optind;
+    job->results = emalloc(argc * sizeof(File_Result));
+    memset(job->results, 0, argc * sizeof(File_Result));
+    n = files < threads ? (files ? files : 1) : threads;
+    job->parts = threads / n;   /* threads left over read large files in parts */
+    pthread_mutex_init(&job->lock, NULL);
+    memset(worker, 0, n * sizeof(Worker));
+    for (k = 0; k < n; k++)
+    {
+        worker[k].job = job;
+        worker[k].top = job->top ? top_new(job->top) : NULL;
+        worker[k].spool = job->export ? spool_new() : NULL;
+        if (k > 0 && pthread_create(&worker[k].thread, NULL, analyze_worker, &worker[k]) != 0)
+        {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    analyze_worker(&worker[0]);
+    memset(&groups, 0, sizeof(groups));
+    for (k = 0; k < n; k++)
+    {
+        if (k > 0)
+            pthread_join(worker[k].thread, NULL);
+        stats_add(total, &worker[k].total);
+        groups_merge(&groups, &worker[k].groups);
+        if (k > 0 && worker[k].top)
+            top_merge(worker[0].top, worker[k].top);
+        if (worker[k].spool)
+            spool_flush(worker[k].spool);
+    }
+    if (job->export)
+    {
+        export_write(job->export, job, files);
+        for (k = 0; k < n; k++)
+            spool_free(worker[k].spool);
+    }
+
+    printf("Replay time of file(s) (sec, HH:mm:ss) and number of records:\n");
+    for (i = optind; i < argc; i++)
+    {
+        File_Result *r = &job->results[i];
+        long long duration = r->duration;
+        long long hrs = duration / 3600;
+        int min = (duration - hrs * 3600) / 60;
+        int sec = duration - hrs * 3600 - min * 60;
+
+        if (job->quick && !r->cached)
+            printf("(%7lld	%lld:%02d:%02d) - %s\n", duration, hrs, min, sec, argv[i]);
+        else
+            printf("(%7lld	%lld:%02d:%02d) %lld %s\n", duration, hrs, min, sec, r->records, argv[i]);
+        if (r->an)
+        {
+            print_anomalies(r->an);
+            anomalies += r->an->count;
+            bad++;
+            free(r->an);
+        }
+        full += r->full;
+    }
+    free(job->results);
+    if (job->report)
+        printf("%lld anomalies in %d file(s).\n", anomalies, bad);
+    if (job->quick)
+        printf("%d file(s) read through, end of the rest found from the end.\n", full);
+    if (job->cache)
+    {
+        printf("%d file(s) analyzed, %d from cache.\n\n", files, job->cache->hits);
+        cache_save(job->cache);
+    }
+    else
+        printf("%d file(s) analyzed.\n\n", files);
+    if (job->top)
+    {
+        print_tops(worker[0].top, argv);
+        top_free(worker[0].top);
+    }
+    if (job->group != GROUP_OFF)
+        print_groups(&groups, job->quick);
+    return files;
+}
+
+int main(int argc, char **argv)
+{
+    int i, ch, j, files = 0, merge = 0, quick = 0, chunks = 0, report = 0, top = 0;
+    char *export = NULL;
+    char *partial = NULL;
+    Cache *cache = NULL;
+    Stats total;
+    Job job;
+    set_progname(argv[0]);
+    memset(&job, 0, sizeof(job));
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((ch = getopt(argc, argv, "aC:e:g:j:mo:qt:x:")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'a':
+            report = 1;
+            break;
+        case 'C':
+            cache = cache_load(optarg);
+            break;
+        case 'e':
+            chunks = atoi(optarg) < 2 ? -1 : atoi(optarg);   /* no variance from one */
+            break;
+        case 'g':
+            if (strcmp(optarg, "day") == 0)
+                job.group = GROUP_DAY;
+            else if (strcmp(optarg, "month") == 0)
+                job.group = GROUP_MONTH;
+            else if ((j = regcomp(&job.regex, optarg, REG_EXTENDED)) == 0)
+                job.group = GROUP_REGEX;
+            else
+            {
+                char err[256];
+
+                regerror(j, &job.regex, err, sizeof(err));
+                fprintf(stderr, "%s: %s: %s\n", get_progname(), optarg, err);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'm':
+            merge = 1;
+            break;
+        case 'o':
+            partial = optarg;
+            break;
+        case 'q':
+            quick = 1;
+            break;
+        case 't':
+            top = atoi(optarg) < 1 || atoi(optarg) > TOP_MAX ? -1 : atoi(optarg);
+            break;
+        case 'x':
+            export = optarg;
+            break;
+        default:
+            argc = 1;
+        }
+    }
+    if (threads < 1 || threads > MAX_THREADS)
+        threads = threads < 1 ? 1 : MAX_THREADS;
+    if (optind >= argc || (quick && (merge || partial)) || (report && (quick || merge)) ||
+        (job.group && (merge || chunks)) || 
+        chunks < 0 || (chunks && (quick || merge || partial || cache || report)) ||
+        top < 0 || (top && (quick || merge || chunks)) ||
+        (export && (quick || merge || chunks)))
+    {
+        char *pgmname = strdup(argv[0]);
+        printf("Usage: %s [-a] [-C cachefile] [-g group] [-j threads] [-o partial] [-t n] [-x export] file [file]...\n", basename(pgmname));
+        printf("       %s -q [-C cachefile] [-g group] [-j threads] file [file]...\n", basename(pgmname));
+        printf("       %s -m [-o partial] partial [partial]...\n", basename(pgmname));
+        printf("       %s -e chunks file [file]...\n", basename(pgmname));
+        exit(1);
+    }
+    memset(&total, 0, sizeof(total));
+    if (chunks)
+    {
+        estimate_files(argc, argv, chunks);
+        return 0;
+    }
+
+    if (merge)
+    {
+        for (i = optind; i < argc; i++)
+            files += partial_read(argv[i], &total);
+        printf("%d file(s) merged from %d partial result(s).\n\n", files, argc - optind);
+    }
+    else
+    {
+        job.cache = cache;
+        job.quick = quick;
+        job.report = report;
+        job.top = top;
+        job.export = export;
+        files = analyze_files(argc, argv, &job, &total);
+    }
+    if (partial)
+        partial_write(partial, &total, files);
+    if (quick)
+    {
+        printf("Total time: %lld sec.\n", total.duration);
+        return 0;
+    }
+
     printf("Length distribution of screen updates:\n");
-    int records = 0;
-    for (j = 0; j < 20; j++)
+    long long records = 0;
+    for (j = 0; j < LENGTH_BUCKETS; j++)
     {
-        if (lengths[j])
+        if (total.lengths[j])
         {
-            records += lengths[j];
-            printf("< %d\t(2^%d)\t%d\t", (int)(pow(2, j)), j, lengths[j]);
+            records += total.lengths[j];
+            printf("< %.0f\t(2^%d)\t%lld\t", pow(2, j), j, total.lengths[j]);
             for (int foo, k = 20; k; --k)
             {
-                if (foo = (int)(lengths[j] / pow(2, k)))
+                if (foo = (int)(total.lengths[j] / pow(2, k)))
                 {
                     putchar('*');
-                    lengths[j] -= (int)pow(2, k);
+                    total.lengths[j] -= (long long)pow(2, k);
                 }
             }
             putchar('\n');
         }
     }
-    printf("Total records: %d, magnitude = 2^%d\n", records, (int)log2(records));
+    printf("Total records: %lld, magnitude = 2^%d\n", records, (int)log2(records));
 
     printf("Duration distribution of actions, sec:\n");
 
-    for (j = 0; j < 30; j++)
+    for (j = 0; j < TIME_BUCKETS; j++)
     {
-        if (times[j])
+        if (total.times[j])
         {
-            printf("< %d\t(2^%d)\t%d\t", (int)pow(2, j), j, times[j]);
+            printf("< %.0f\t(2^%d)\t%lld\t", pow(2, j), j, total.times[j]);
             for (int k = 20; k; --k)
             {
-                if ((int)(times[j] / pow(2, k)))
+                if ((int)(total.times[j] / pow(2, k)))
                 {
                     putchar('*');
-                    times[j] -= (int)pow(2, k);
+                    total.times[j] -= (long long)pow(2, k);
                 }
             }
             putchar('\n');
         }
     }
-    printf("Total time: %d sec.\n", total_seconds);
-    printf("Average of action durations: %1.2f sec\n", (float) total_seconds / records);
+    printf("Total time: %lld sec.\n", total.duration);
+    printf("Average of action durations: %1.2f sec\n", (float) total.duration / records);
     return 0;
 }
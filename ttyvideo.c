@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ttyvideo
+ * 
+ * renders a recording into raw video, to be piped into an encoder
+ * 
+ * usage: ttyvideo [-g COLSxROWS] [-i idle] [-j threads] [-r fps] [-s scale] file
+ * 
+ * the recording is played into a terminal model, cf. vt.c, of 80x24
+ * unless -g is given, and its screen is drawn with a built-in 5x8 font
+ * in cells of CELL_W x CELL_H pixels, times -s, 2 by default. Frames of
+ * 8 bit RGB, row by row from the top, are written to stdout at -r fps,
+ * 30 by default, each showing what the recording shows at its time.
+ * Idle time is cut to -i sec, 2 by default. The size of frames is told
+ * on stderr, e.g. for
+ * 
+ *     ttyvideo foo.ttyrec | ffmpeg -f rawvideo -pix_fmt rgb24 \
+ *         -s 960x480 -r 30 -i - foo.mp4
+ * 
+ * only cells that changed since the last frame are drawn again, shared
+ * out among -j threads, by default one for each processor online.
+ * Characters outside ASCII are drawn as '?', box drawing as ASCII.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <pthread.h>
+
+#include "io.h"
+#include "ttyrec.h"
+#include "vt.h"
+
+#define FRAME_RATE      30      /* frames per sec, unless -r */
+#define IDLE_MAX        2.0     /* sec of idle kept, unless -i */
+#define SCALE           2       /* unless -s */
+#define SCALE_MAX       8
+#define MAX_THREADS     64
+#define CELL_W          6       /* px, 5 of glyph and 1 between */
+#define CELL_H          10      /* px, 1 above glyph, 8 of it and 1 below */
+#define GLYPH_TOP       1
+#define UNDERLINE       9       /* row of cell underlined */
+
+/* 5x8 font for ASCII 0x20..0x7e, a byte for each row from the top, the
+    leftmost pixel in the high bit, descenders in the last row */
+static const unsigned char font[95][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  /*   */
+    { 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x20, 0x00 },  /* ! */
+    { 0x50, 0x50, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* " */
+    { 0x50, 0x50, 0xf8, 0x50, 0xf8, 0x50, 0x50, 0x00 },  /* # */
+    { 0x20, 0x78, 0xa0, 0x70, 0x28, 0xf0, 0x20, 0x00 },  /* $ */
+    { 0xc0, 0xc8, 0x10, 0x20, 0x40, 0x98, 0x18, 0x00 },  /* % */
+    { 0x60, 0x90, 0xa0, 0x40, 0xa8, 0x90, 0x68, 0x00 },  /* & */
+    { 0x20, 0x20, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* ' */
+    { 0x10, 0x20, 0x40, 0x40, 0x40, 0x20, 0x10, 0x00 },  /* ( */
+    { 0x40, 0x20, 0x10, 0x10, 0x10, 0x20, 0x40, 0x00 },  /* ) */
+    { 0x00, 0x20, 0xa8, 0x70, 0xa8, 0x20, 0x00, 0x00 },  /* * */
+    { 0x00, 0x20, 0x20, 0xf8, 0x20, 0x20, 0x00, 0x00 },  /* + */
+    { 0x00, 0x00, 0x00, 0x00, 0x60, 0x20, 0x40, 0x00 },  /* , */
+    { 0x00, 0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00 },  /* - */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x60, 0x00 },  /* . */
+    { 0x00, 0x08, 0x10, 0x20, 0x40, 0x80, 0x00, 0x00 },  /* / */
+    { 0x70, 0x88, 0x98, 0xa8, 0xc8, 0x88, 0x70, 0x00 },  /* 0 */
+    { 0x20, 0x60, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00 },  /* 1 */
+    { 0x70, 0x88, 0x08, 0x10, 0x20, 0x40, 0xf8, 0x00 },  /* 2 */
+    { 0xf8, 0x10, 0x20, 0x10, 0x08, 0x88, 0x70, 0x00 },  /* 3 */
+    { 0x10, 0x30, 0x50, 0x90, 0xf8, 0x10, 0x10, 0x00 },  /* 4 */
+    { 0xf8, 0x80, 0xf0, 0x08, 0x08, 0x88, 0x70, 0x00 },  /* 5 */
+    { 0x30, 0x40, 0x80, 0xf0, 0x88, 0x88, 0x70, 0x00 },  /* 6 */
+    { 0xf8, 0x08, 0x10, 0x20, 0x40, 0x40, 0x40, 0x00 },  /* 7 */
+    { 0x70, 0x88, 0x88, 0x70, 0x88, 0x88, 0x70, 0x00 },  /* 8 */
+    { 0x70, 0x88, 0x88, 0x78, 0x08, 0x10, 0x60, 0x00 },  /* 9 */
+    { 0x00, 0x60, 0x60, 0x00, 0x60, 0x60, 0x00, 0x00 },  /* : */
+    { 0x00, 0x60, 0x60, 0x00, 0x60, 0x20, 0x40, 0x00 },  /* ; */
+    { 0x10, 0x20, 0x40, 0x80, 0x40, 0x20, 0x10, 0x00 },  /* < */
+    { 0x00, 0x00, 0xf8, 0x00, 0xf8, 0x00, 0x00, 0x00 },  /* = */
+    { 0x40, 0x20, 0x10, 0x08, 0x10, 0x20, 0x40, 0x00 },  /* > */
+    { 0x70, 0x88, 0x08, 0x10, 0x20, 0x00, 0x20, 0x00 },  /* ? */
+    { 0x70, 0x88, 0x08, 0x68, 0xa8, 0xa8, 0x70, 0x00 },  /* @ */
+    { 0x70, 0x88, 0x88, 0xf8, 0x88, 0x88, 0x88, 0x00 },  /* A */
+    { 0xf0, 0x88, 0x88, 0xf0, 0x88, 0x88, 0xf0, 0x00 },  /* B */
+    { 0x70, 0x88, 0x80, 0x80, 0x80, 0x88, 0x70, 0x00 },  /* C */
+    { 0xe0, 0x90, 0x88, 0x88, 0x88, 0x90, 0xe0, 0x00 },  /* D */
+    { 0xf8, 0x80, 0x80, 0xf0, 0x80, 0x80, 0xf8, 0x00 },  /* E */
+    { 0xf8, 0x80, 0x80, 0xf0, 0x80, 0x80, 0x80, 0x00 },  /* F */
+    { 0x70, 0x88, 0x80, 0xb8, 0x88, 0x88, 0x78, 0x00 },  /* G */
+    { 0x88, 0x88, 0x88, 0xf8, 0x88, 0x88, 0x88, 0x00 },  /* H */
+    { 0x70, 0x20, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00 },  /* I */
+    { 0x38, 0x10, 0x10, 0x10, 0x10, 0x90, 0x60, 0x00 },  /* J */
+    { 0x88, 0x90, 0xa0, 0xc0, 0xa0, 0x90, 0x88, 0x00 },  /* K */
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xf8, 0x00 },  /* L */
+    { 0x88, 0xd8, 0xa8, 0xa8, 0x88, 0x88, 0x88, 0x00 },  /* M */
+    { 0x88, 0x88, 0xc8, 0xa8, 0x98, 0x88, 0x88, 0x00 },  /* N */
+    { 0x70, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70, 0x00 },  /* O */
+    { 0xf0, 0x88, 0x88, 0xf0, 0x80, 0x80, 0x80, 0x00 },  /* P */
+    { 0x70, 0x88, 0x88, 0x88, 0xa8, 0x90, 0x68, 0x00 },  /* Q */
+    { 0xf0, 0x88, 0x88, 0xf0, 0xa0, 0x90, 0x88, 0x00 },  /* R */
+    { 0x78, 0x80, 0x80, 0x70, 0x08, 0x08, 0xf0, 0x00 },  /* S */
+    { 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00 },  /* T */
+    { 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70, 0x00 },  /* U */
+    { 0x88, 0x88, 0x88, 0x88, 0x88, 0x50, 0x20, 0x00 },  /* V */
+    { 0x88, 0x88, 0x88, 0xa8, 0xa8, 0xa8, 0x50, 0x00 },  /* W */
+    { 0x88, 0x88, 0x50, 0x20, 0x50, 0x88, 0x88, 0x00 },  /* X */
+    { 0x88, 0x88, 0x88, 0x50, 0x20, 0x20, 0x20, 0x00 },  /* Y */
+    { 0xf8, 0x08, 0x10, 0x20, 0x40, 0x80, 0xf8, 0x00 },  /* Z */
+    { 0x70, 0x40, 0x40, 0x40, 0x40, 0x40, 0x70, 0x00 },  /* [ */
+    { 0x00, 0x80, 0x40, 0x20, 0x10, 0x08, 0x00, 0x00 },  /* \ */
+    { 0x70, 0x10, 0x10, 0x10, 0x10, 0x10, 0x70, 0x00 },  /* ] */
+    { 0x20, 0x50, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* ^ */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00 },  /* _ */
+    { 0x40, 0x20, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* ` */
+    { 0x00, 0x00, 0x70, 0x08, 0x78, 0x88, 0x78, 0x00 },  /* a */
+    { 0x80, 0x80, 0xb0, 0xc8, 0x88, 0x88, 0xf0, 0x00 },  /* b */
+    { 0x00, 0x00, 0x70, 0x80, 0x80, 0x88, 0x70, 0x00 },  /* c */
+    { 0x08, 0x08, 0x68, 0x98, 0x88, 0x88, 0x78, 0x00 },  /* d */
+    { 0x00, 0x00, 0x70, 0x88, 0xf8, 0x80, 0x70, 0x00 },  /* e */
+    { 0x30, 0x48, 0x40, 0xe0, 0x40, 0x40, 0x40, 0x00 },  /* f */
+    { 0x00, 0x00, 0x78, 0x88, 0x88, 0x78, 0x08, 0x70 },  /* g */
+    { 0x80, 0x80, 0xb0, 0xc8, 0x88, 0x88, 0x88, 0x00 },  /* h */
+    { 0x20, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00 },  /* i */
+    { 0x10, 0x00, 0x30, 0x10, 0x10, 0x10, 0x90, 0x60 },  /* j */
+    { 0x80, 0x80, 0x90, 0xa0, 0xc0, 0xa0, 0x90, 0x00 },  /* k */
+    { 0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00 },  /* l */
+    { 0x00, 0x00, 0xd0, 0xa8, 0xa8, 0x88, 0x88, 0x00 },  /* m */
+    { 0x00, 0x00, 0xb0, 0xc8, 0x88, 0x88, 0x88, 0x00 },  /* n */
+    { 0x00, 0x00, 0x70, 0x88, 0x88, 0x88, 0x70, 0x00 },  /* o */
+    { 0x00, 0x00, 0xf0, 0x88, 0x88, 0xf0, 0x80, 0x80 },  /* p */
+    { 0x00, 0x00, 0x78, 0x88, 0x88, 0x78, 0x08, 0x08 },  /* q */
+    { 0x00, 0x00, 0xb0, 0xc8, 0x80, 0x80, 0x80, 0x00 },  /* r */
+    { 0x00, 0x00, 0x78, 0x80, 0x70, 0x08, 0xf0, 0x00 },  /* s */
+    { 0x40, 0x40, 0xe0, 0x40, 0x40, 0x48, 0x30, 0x00 },  /* t */
+    { 0x00, 0x00, 0x88, 0x88, 0x88, 0x98, 0x68, 0x00 },  /* u */
+    { 0x00, 0x00, 0x88, 0x88, 0x88, 0x50, 0x20, 0x00 },  /* v */
+    { 0x00, 0x00, 0x88, 0x88, 0xa8, 0xa8, 0x50, 0x00 },  /* w */
+    { 0x00, 0x00, 0x88, 0x50, 0x20, 0x50, 0x88, 0x00 },  /* x */
+    { 0x00, 0x00, 0x88, 0x88, 0x88, 0x78, 0x08, 0x70 },  /* y */
+    { 0x00, 0x00, 0xf8, 0x10, 0x20, 0x40, 0xf8, 0x00 },  /* z */
+    { 0x10, 0x20, 0x20, 0x40, 0x20, 0x20, 0x10, 0x00 },  /* { */
+    { 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00 },  /* | */
+    { 0x40, 0x20, 0x20, 0x10, 0x20, 0x20, 0x40, 0x00 },  /* } */
+    { 0x00, 0x00, 0x40, 0xa8, 0x10, 0x00, 0x00, 0x00 },  /* ~ */
+};
+
+typedef struct VIDEO
+{
+    Vt vt;
+    Vt_Cell *shown;         /* cells as of last frame */
+    int cursor_x, cursor_y, cursor_shown;   /* as of last frame */
+    int scale, width, height;   /* of frame, px */
+    unsigned char *frame;   /* width * height * 3 */
+    int *todo, count;       /* cells to draw for this frame */
+    int threads;
+    pthread_barrier_t start, done;
+    int quit;
+} Video;
+
+typedef struct DRAWER
+{
+    pthread_t thread;
+    Video *v;
+    int k;                  /* draws every threads'th cell from k on */
+} Drawer;
+
+void usage(const char *argv0)
+{
+    char *pgmname = strdup(argv0);
+    printf("Usage: %s [-g COLSxROWS] [-i idle] [-j threads] [-r fps] [-s scale] file\n", basename(pgmname));
+    printf("  -g  size of screen, default %dx%d\n", VT_COLS, VT_ROWS);
+    printf("  -i  sec of idle time kept at most, default %.0f\n", IDLE_MAX);
+    printf("  -j  threads drawing, default one for each processor\n");
+    printf("  -r  frames per sec, default %d\n", FRAME_RATE);
+    printf("  -s  %dx%d pixels of a cell times scale, default %d\n", CELL_W, CELL_H, SCALE);
+    printf("frames of COLS * %d * scale x ROWS * %d * scale RGB go to stdout\n", CELL_W, CELL_H);
+    exit(EXIT_FAILURE);
+}
+
+static const unsigned char *
+glyph (unsigned int ch)
+{
+    if (ch >= 0x2500 && ch < 0x2580)    /* box drawing */
+        ch = ch <= 0x2501 ? '-' : ch <= 0x2503 ? '|' : '+';
+    else if (ch >= 0x23ba && ch <= 0x23bd)  /* scan lines */
+        ch = '-';
+    else if (ch == 0x25c6)
+        ch = '*';
+    else if (ch == 0x2592)
+        ch = '#';
+    else if (ch == 0x00b7)
+        ch = '.';
+    if (ch < 0x20 || ch > 0x7e)
+        ch = '?';
+    return font[ch - 0x20];
+}
+
+/* draw cell i of screen into frame */
+static void
+draw_cell (Video *v, int i)
+{
+    Vt_Cell *c = &v->vt.screen[i];
+    int x0 = i % v->vt.cols * CELL_W * v->scale, y0 = i / v->vt.cols * CELL_H * v->scale;
+    const unsigned char *g = glyph(c->ch);
+    unsigned int fg, bg, t;
+    unsigned char rgb[2][3];
+    int px, py, gy, bits;
+
+    vt_cell_colors(c, &fg, &bg);
+    if (c->attr & VT_DIM)
+        fg = (fg >> 1) & 0x7f7f7f;
+    if (v->cursor_shown && i == v->cursor_y * v->vt.cols + v->cursor_x)
+    {
+        t = fg;
+        fg = bg;
+        bg = t;
+    }
+    rgb[0][0] = bg >> 16;
+    rgb[0][1] = bg >> 8;
+    rgb[0][2] = bg;
+    rgb[1][0] = fg >> 16;
+    rgb[1][1] = fg >> 8;
+    rgb[1][2] = fg;
+    for (py = 0; py < CELL_H * v->scale; py++)
+    {
+        unsigned char *p = v->frame + ((y0 + py) * v->width + x0) * 3;
+
+        gy = py / v->scale - GLYPH_TOP;
+        bits = gy >= 0 && gy < 8 ? g[gy] : 0;
+        if (c->attr & VT_BOLD)
+            bits |= bits >> 1;
+        if ((c->attr & VT_UNDERLINE) && gy + GLYPH_TOP == UNDERLINE)
+            bits = 0xfc;
+        for (px = 0; px < CELL_W * v->scale; px++, p += 3)
+            memcpy(p, rgb[(bits >> (7 - px / v->scale)) & 1], 3);
+    }
+}
+
+/* draw share k of the cells to draw */
+static void
+draw_share (Video *v, int k)
+{
+    int i;
+
+    for (i = k; i < v->count; i += v->threads)
+        draw_cell(v, v->todo[i]);
+}
+
+static void *
+drawer (void *arg)
+{
+    Drawer *d = arg;
+    Video *v = d->v;
+
+    while (1)
+    {
+        pthread_barrier_wait(&v->start);
+        if (v->quit)
+            break;
+        draw_share(v, d->k);
+        pthread_barrier_wait(&v->done);
+    }
+    return NULL;
+}
+
+/* bring frame up to date with the screen and write it */
+void frame(Video *v)
+{
+    Vt *vt = &v->vt;
+    int i, n = vt->rows * vt->cols;
+    int cursor_shown = !vt->cursor_hidden;
+    int old = v->cursor_y * vt->cols + v->cursor_x, now = vt->y * vt->cols + vt->x;
+
+    v->count = 0;
+    for (i = 0; i < n; i++)
+        if ((vt->dirty[i] && memcmp(&vt->screen[i], &v->shown[i], sizeof(Vt_Cell)) != 0) ||
+            ((i == old || i == now) && (old != now || cursor_shown != v->cursor_shown)))
+        {
+            v->todo[v->count++] = i;
+            v->shown[i] = vt->screen[i];
+        }
+    vt_clean(vt);
+    v->cursor_x = vt->x;
+    v->cursor_y = vt->y;
+    v->cursor_shown = cursor_shown;
+    if (v->threads > 1 && v->count > 1)
+    {
+        pthread_barrier_wait(&v->start);
+        draw_share(v, 0);
+        pthread_barrier_wait(&v->done);
+    }
+    else
+        for (i = 0; i < v->count; i++)
+            draw_cell(v, v->todo[i]);
+    if (fwrite(v->frame, 3, v->width * v->height, stdout) != v->width * v->height)
+    {
+        perror("stdout");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ch, i, rows = VT_ROWS, cols = VT_COLS, fps = FRAME_RATE;
+    double idle = IDLE_MAX, t = 0;
+    long long records = 0, frames = 0;
+    Drawer drawers[MAX_THREADS];
+    struct timeval prev;
+    char *buf = NULL;
+    long long bufsize = 0;
+    FILE *in;
+    Header h;
+    Video v;
+
+    set_progname(argv[0]);
+    memset(&v, 0, sizeof(v));
+    v.scale = SCALE;
+    v.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((ch = getopt(argc, argv, "g:i:j:r:s:")) != EOF)
+    {
+        switch (ch)
+        {
+        case 'g':
+            if (!vt_parse_size(optarg, &rows, &cols))
+                usage(argv[0]);
+            break;
+        case 'i':
+            idle = atof(optarg);
+            break;
+        case 'j':
+            v.threads = atoi(optarg);
+            break;
+        case 'r':
+            fps = atoi(optarg);
+            break;
+        case 's':
+            v.scale = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 || fps < 1 || idle < 0 || v.scale < 1 || v.scale > SCALE_MAX)
+        usage(argv[0]);
+    if (v.threads < 1 || v.threads > MAX_THREADS)
+        v.threads = v.threads < 1 ? 1 : MAX_THREADS;
+
+    in = ttyopen(argv[optind]);
+    vt_init(&v.vt, rows, cols);
+    v.width = cols * CELL_W * v.scale;
+    v.height = rows * CELL_H * v.scale;
+    v.frame = emalloc(v.width * v.height * 3);
+    v.shown = emalloc(rows * cols * sizeof(Vt_Cell));
+    v.todo = emalloc(rows * cols * sizeof(int));
+    memcpy(v.shown, v.vt.screen, rows * cols * sizeof(Vt_Cell));
+    for (i = 0; i < rows * cols; i++)   /* all drawn in the first frame */
+        v.shown[i].ch = 0;
+    v.cursor_shown = 0;
+    fprintf(stderr, "%s: %dx%d rgb24 at %d fps\n", get_progname(), v.width, v.height, fps);
+    if (v.threads > 1)
+    {
+        pthread_barrier_init(&v.start, NULL, v.threads);
+        pthread_barrier_init(&v.done, NULL, v.threads);
+        for (i = 1; i < v.threads; i++)
+        {
+            drawers[i].v = &v;
+            drawers[i].k = i;
+            if (pthread_create(&drawers[i].thread, NULL, drawer, &drawers[i]) != 0)
+            {
+                perror("pthread_create");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    while (read_header(in, &h))
+    {
+        if (h.len < 0)
+        {
+            fprintf(stderr, "%s: record #%lld of negative length, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (h.len > bufsize)
+        {
+            bufsize = h.len;
+            if ((buf = realloc(buf, bufsize)) == NULL)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fread(buf, 1, h.len, in) != h.len)
+        {
+            fprintf(stderr, "%s: truncated record #%lld, rest is dropped\n", 
+                    argv[optind], records + 1);
+            break;
+        }
+        if (records > 0)
+        {
+            double gap = (h.tv.tv_sec - prev.tv_sec) + (h.tv.tv_usec - prev.tv_usec) / 1e6;
+
+            t += gap < 0 ? 0 : gap > idle ? idle : gap;
+        }
+        for (; (double)frames / fps < t; frames++)    /* frames before record */
+            frame(&v);
+        vt_write(&v.vt, buf, h.len);
+        prev = h.tv;
+        records++;
+    }
+    frame(&v);
+
+    if (v.threads > 1)
+    {
+        v.quit = 1;
+        pthread_barrier_wait(&v.start);
+        for (i = 1; i < v.threads; i++)
+            pthread_join(drawers[i].thread, NULL);
+    }
+    if (fflush(stdout) == EOF)
+    {
+        perror("stdout");
+        exit(EXIT_FAILURE);
+    }
+    ttyclose(in);
+    vt_free(&v.vt);
+    free(v.frame);
+    free(v.shown);
+    free(v.todo);
+    free(buf);
+    return 0;
+}
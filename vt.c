@@ -0,0 +1,858 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* 
+ * vt: terminal model, cf. ttyrec.h
+ * 
+ * Output is played into a screen of cells as xterm would show it, for
+ * transcripts and renderings of what a recording shows. The usual
+ * sequences of curses programs and shells are understood: cursor 
+ * motion, erasing, inserting and deleting, scrolling regions, SGR with
+ * 256 colors, the alternate screen and DEC line drawing, which is kept
+ * as the Unicode characters it shows. Others are parsed and ignored. Runs of printable ASCII are
+ * put on the screen without going through the parser.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ttyrec.h"
+#include "io.h"
+#include "vt.h"
+
+/* states of the parser */
+#define V_TEXT          0
+#define V_ESC           1   /* after ESC */
+#define V_ESC_INTER     2   /* ESC and intermediate, wait for final */
+#define V_CSI           3   /* ESC [, parameters until final */
+#define V_STRING        4   /* OSC, DCS, SOS, PM, APC until BEL or ST */
+#define V_STRING_ESC    5   /* ESC in string, ST if \ follows */
+
+#define CELL(vt, x, y)  ((vt)->screen[(y) * (vt)->cols + (x)])
+
+/* DEC line drawing for 0x60..0x7e, in Unicode */
+static const unsigned short line_drawing[] = {
+    0x25c6, 0x2592, 0x2409, 0x240c, 0x240d, 0x240a, 0x00b0, 0x00b1,
+    0x2424, 0x240b, 0x2518, 0x2510, 0x250c, 0x2514, 0x253c, 0x23ba,
+    0x23bb, 0x2500, 0x23bc, 0x23bd, 0x251c, 0x2524, 0x2534, 0x252c,
+    0x2502, 0x2264, 0x2265, 0x03c0, 0x2260, 0x00a3, 0x00b7
+};
+
+static Vt_Cell
+blank (const Vt *vt)
+{
+    Vt_Cell c = vt->pen;
+
+    c.ch = ' ';
+    c.attr &= VT_BG;    /* erased cells keep background only */
+    return c;
+}
+
+static void
+fill (Vt *vt, int from, int to, Vt_Cell c)
+{
+    int i;
+
+    for (i = from; i < to; i++) {
+	vt->screen[i] = c;
+	vt->dirty[i] = 1;
+    }
+}
+
+static void
+touch (Vt *vt, int from, int to)
+{
+    memset(vt->dirty + from, 1, to - from);
+}
+
+static int
+line_blank (const Vt_Cell *line, int cols)
+{
+    int x;
+
+    for (x = 0; x < cols; x++) {
+	if (line[x].ch != ' ') {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/* pass rows from..to of screen to lost(), if they are shown: trailing
+    blank ones are not */
+static void
+lose_screen (Vt *vt, int from, int to)
+{
+    int y;
+
+    if (vt->lost == NULL) {
+	return;
+    }
+    while (to > from && line_blank(&CELL(vt, 0, to - 1), vt->cols)) {
+	to--;
+    }
+    for (y = from; y < to; y++) {
+	vt->lost(vt->ctx, &CELL(vt, 0, y), vt->cols);
+    }
+}
+
+/* scroll rows top..bottom up by n, lines off the top of the screen are 
+    lost */
+static void
+scroll_up (Vt *vt, int top, int bottom, int n)
+{
+    int size = (bottom - top + 1);
+
+    if (n > size) {
+	n = size;
+    }
+    if (top == 0 && bottom == vt->rows - 1) {
+	vt->scrolled += n;
+    }
+    if (top == 0 && vt->lost) {
+	int y;
+
+	for (y = 0; y < n; y++) {
+	    vt->lost(vt->ctx, &CELL(vt, 0, y), vt->cols);
+	}
+    }
+    memmove(&CELL(vt, 0, top), &CELL(vt, 0, top + n), 
+	    (size - n) * vt->cols * sizeof(Vt_Cell));
+    fill(vt, (bottom + 1 - n) * vt->cols, (bottom + 1) * vt->cols, blank(vt));
+    touch(vt, top * vt->cols, (bottom + 1) * vt->cols);
+}
+
+static void
+scroll_down (Vt *vt, int top, int bottom, int n)
+{
+    int size = (bottom - top + 1);
+
+    if (n > size) {
+	n = size;
+    }
+    memmove(&CELL(vt, 0, top + n), &CELL(vt, 0, top), 
+	    (size - n) * vt->cols * sizeof(Vt_Cell));
+    fill(vt, top * vt->cols, (top + n) * vt->cols, blank(vt));
+    touch(vt, top * vt->cols, (bottom + 1) * vt->cols);
+}
+
+static void
+line_feed (Vt *vt)
+{
+    if (vt->y == vt->bottom) {
+	scroll_up(vt, vt->top, vt->bottom, 1);
+    } else if (vt->y < vt->rows - 1) {
+	vt->y++;
+    }
+}
+
+static void
+reverse_index (Vt *vt)
+{
+    if (vt->y == vt->top) {
+	scroll_down(vt, vt->top, vt->bottom, 1);
+    } else if (vt->y > 0) {
+	vt->y--;
+    }
+}
+
+static void
+move_to (Vt *vt, int x, int y)
+{
+    int top = vt->origin ? vt->top : 0;
+    int bottom = vt->origin ? vt->bottom : vt->rows - 1;
+
+    y += top;
+    vt->x = x < 0 ? 0 : x >= vt->cols ? vt->cols - 1 : x;
+    vt->y = y < top ? top : y > bottom ? bottom : y;
+    vt->wrap = 0;
+}
+
+/* put character ch at cursor */
+static void
+put (Vt *vt, unsigned int ch)
+{
+    int i;
+
+    if (vt->wrap) {
+	if (!vt->autowrap_off) {
+	    vt->x = 0;
+	    line_feed(vt);
+	}
+	vt->wrap = 0;
+    }
+    i = vt->y * vt->cols + vt->x;
+    vt->screen[i] = vt->pen;
+    vt->screen[i].ch = ch;
+    vt->dirty[i] = 1;
+    if (vt->x == vt->cols - 1) {
+	vt->wrap = 1;
+    } else {
+	vt->x++;
+    }
+}
+
+static void
+switch_screen (Vt *vt, int alt)
+{
+    Vt_Cell *s;
+
+    if (alt == vt->alt) {
+	return;
+    }
+    if (!alt) {     /* what the alternate screen showed is gone */
+	lose_screen(vt, 0, vt->rows);
+    }
+    s = vt->screen;
+    vt->screen = vt->other;
+    vt->other = s;
+    vt->alt = alt;
+    if (alt) {
+	fill(vt, 0, vt->rows * vt->cols, blank(vt));
+    }
+    touch(vt, 0, vt->rows * vt->cols);
+}
+
+static int
+param (const Vt *vt, int i, int deflt)
+{
+    return i < vt->nparams && vt->params[i] > 0 ? vt->params[i] : deflt;
+}
+
+/* nearest of the 256 colors to r, g, b: the 6x6x6 cube */
+static int
+color_cube (int r, int g, int b)
+{
+    return 16 + 36 * ((r * 5 + 127) / 255) + 6 * ((g * 5 + 127) / 255) + 
+	(b * 5 + 127) / 255;
+}
+
+static void
+sgr (Vt *vt)
+{
+    Vt_Cell *p = &vt->pen;
+    int i, n;
+
+    if (vt->nparams == 0) {
+	vt->nparams = 1;
+	vt->params[0] = 0;
+    }
+    for (i = 0; i < vt->nparams; i++) {
+	n = vt->params[i];
+	if (n == 0) {
+	    p->attr = 0;
+	} else if (n == 1) {
+	    p->attr |= VT_BOLD;
+	} else if (n == 2) {
+	    p->attr |= VT_DIM;
+	} else if (n == 3) {
+	    p->attr |= VT_ITALIC;
+	} else if (n == 4) {
+	    p->attr |= VT_UNDERLINE;
+	} else if (n == 5) {
+	    p->attr |= VT_BLINK;
+	} else if (n == 7) {
+	    p->attr |= VT_REVERSE;
+	} else if (n == 22) {
+	    p->attr &= ~(VT_BOLD | VT_DIM);
+	} else if (n == 23) {
+	    p->attr &= ~VT_ITALIC;
+	} else if (n == 24) {
+	    p->attr &= ~VT_UNDERLINE;
+	} else if (n == 25) {
+	    p->attr &= ~VT_BLINK;
+	} else if (n == 27) {
+	    p->attr &= ~VT_REVERSE;
+	} else if (n >= 30 && n <= 37) {
+	    p->fg = n - 30;
+	    p->attr |= VT_FG;
+	} else if (n == 39) {
+	    p->attr &= ~VT_FG;
+	} else if (n >= 40 && n <= 47) {
+	    p->bg = n - 40;
+	    p->attr |= VT_BG;
+	} else if (n == 49) {
+	    p->attr &= ~VT_BG;
+	} else if (n >= 90 && n <= 97) {
+	    p->fg = n - 90 + 8;
+	    p->attr |= VT_FG;
+	} else if (n >= 100 && n <= 107) {
+	    p->bg = n - 100 + 8;
+	    p->attr |= VT_BG;
+	} else if ((n == 38 || n == 48) && i + 1 < vt->nparams) {
+	    int c = -1;
+
+	    if (vt->params[i + 1] == 5 && i + 2 < vt->nparams) {
+		c = vt->params[i + 2] & 0xff;
+		i += 2;
+	    } else if (vt->params[i + 1] == 2 && i + 4 < vt->nparams) {
+		c = color_cube(vt->params[i + 2] & 0xff, vt->params[i + 3] & 0xff,
+			       vt->params[i + 4] & 0xff);
+		i += 4;
+	    }
+	    if (c >= 0 && n == 38) {
+		p->fg = c;
+		p->attr |= VT_FG;
+	    } else if (c >= 0) {
+		p->bg = c;
+		p->attr |= VT_BG;
+	    }
+	}
+    }
+}
+
+static void
+set_mode (Vt *vt, int on)
+{
+    int i;
+
+    for (i = 0; i < vt->nparams; i++) {
+	if (vt->private != '?') {
+	    continue;
+	}
+	switch (vt->params[i]) {
+	case 6:
+	    vt->origin = on;
+	    move_to(vt, 0, 0);
+	    break;
+	case 7:
+	    vt->autowrap_off = !on;
+	    break;
+	case 25:
+	    vt->cursor_hidden = !on;
+	    break;
+	case 1049:
+	    if (on) {
+		vt->saved_x = vt->x;
+		vt->saved_y = vt->y;
+		vt->saved_pen = vt->pen;
+	    }
+	    switch_screen(vt, on);
+	    if (!on) {
+		move_to(vt, vt->saved_x, vt->saved_y);
+		vt->pen = vt->saved_pen;
+	    }
+	    break;
+	case 47:
+	case 1047:
+	    switch_screen(vt, on);
+	    break;
+	}
+    }
+}
+
+static void
+csi (Vt *vt, int c)
+{
+    int n = param(vt, 0, 1), cols = vt->cols, i, end;
+    Vt_Cell *line = &CELL(vt, 0, vt->y);
+
+    if (vt->intermediate) {     /* none that matter */
+	return;
+    }
+    switch (c) {
+    case '@':   /* insert blank chars */
+	if (n > cols - vt->x) {
+	    n = cols - vt->x;
+	}
+	memmove(line + vt->x + n, line + vt->x, (cols - vt->x - n) * sizeof(Vt_Cell));
+	fill(vt, vt->y * cols + vt->x, vt->y * cols + vt->x + n, blank(vt));
+	touch(vt, vt->y * cols + vt->x, (vt->y + 1) * cols);
+	break;
+    case 'A':
+	move_to(vt, vt->x, vt->y - n - (vt->origin ? vt->top : 0));
+	break;
+    case 'B':
+    case 'e':
+	move_to(vt, vt->x, vt->y + n - (vt->origin ? vt->top : 0));
+	break;
+    case 'C':
+    case 'a':
+	move_to(vt, vt->x + n, vt->y - (vt->origin ? vt->top : 0));
+	break;
+    case 'D':
+	move_to(vt, vt->x - n, vt->y - (vt->origin ? vt->top : 0));
+	break;
+    case 'E':
+	move_to(vt, 0, vt->y + n - (vt->origin ? vt->top : 0));
+	break;
+    case 'F':
+	move_to(vt, 0, vt->y - n - (vt->origin ? vt->top : 0));
+	break;
+    case 'G':
+    case '`':
+	move_to(vt, n - 1, vt->y - (vt->origin ? vt->top : 0));
+	break;
+    case 'H':
+    case 'f':
+	move_to(vt, param(vt, 1, 1) - 1, n - 1);
+	break;
+    case 'd':
+	move_to(vt, vt->x, n - 1);
+	break;
+    case 'J':   /* erase in display */
+	n = param(vt, 0, 0);
+	if (n == 0 && vt->x == 0 && vt->y == 0) {
+	    n = 2;  /* all of it, as curses clears */
+	}
+	if (n == 0) {
+	    fill(vt, vt->y * cols + vt->x, vt->rows * cols, blank(vt));
+	} else if (n == 1) {
+	    fill(vt, 0, vt->y * cols + vt->x + 1, blank(vt));
+	} else {
+	    lose_screen(vt, 0, vt->rows);
+	    fill(vt, 0, vt->rows * cols, blank(vt));
+	}
+	break;
+    case 'K':   /* erase in line */
+	n = param(vt, 0, 0);
+	i = n == 0 ? vt->x : 0;
+	end = n == 1 ? vt->x + 1 : cols;
+	fill(vt, vt->y * cols + i, vt->y * cols + end, blank(vt));
+	break;
+    case 'L':
+	if (vt->y >= vt->top && vt->y <= vt->bottom) {
+	    scroll_down(vt, vt->y, vt->bottom, n);
+	}
+	break;
+    case 'M':
+	if (vt->y >= vt->top && vt->y <= vt->bottom) {
+	    scroll_up(vt, vt->y, vt->bottom, n);
+	}
+	break;
+    case 'P':   /* delete chars */
+	if (n > cols - vt->x) {
+	    n = cols - vt->x;
+	}
+	memmove(line + vt->x, line + vt->x + n, (cols - vt->x - n) * sizeof(Vt_Cell));
+	fill(vt, (vt->y + 1) * cols - n, (vt->y + 1) * cols, blank(vt));
+	touch(vt, vt->y * cols + vt->x, (vt->y + 1) * cols);
+	break;
+    case 'S':
+	scroll_up(vt, vt->top, vt->bottom, n);
+	break;
+    case 'T':
+	scroll_down(vt, vt->top, vt->bottom, n);
+	break;
+    case 'X':   /* erase chars */
+	end = vt->x + n > cols ? cols : vt->x + n;
+	fill(vt, vt->y * cols + vt->x, vt->y * cols + end, blank(vt));
+	break;
+    case 'm':
+	if (vt->private == 0) {
+	    sgr(vt);
+	}
+	break;
+    case 'r':
+	i = param(vt, 0, 1) - 1;
+	end = param(vt, 1, vt->rows) - 1;
+	if (end > vt->rows - 1) {
+	    end = vt->rows - 1;
+	}
+	if (i < end) {
+	    vt->top = i;
+	    vt->bottom = end;
+	    move_to(vt, 0, 0);
+	}
+	break;
+    case 's':
+	vt->saved_x = vt->x;
+	vt->saved_y = vt->y;
+	break;
+    case 'u':
+	move_to(vt, vt->saved_x, vt->saved_y);
+	break;
+    case 'h':
+	set_mode(vt, 1);
+	break;
+    case 'l':
+	set_mode(vt, 0);
+	break;
+    }
+}
+
+static void
+esc (Vt *vt, int c)
+{
+    switch (c) {
+    case '7':
+	vt->saved_x = vt->x;
+	vt->saved_y = vt->y;
+	vt->saved_pen = vt->pen;
+	break;
+    case '8':
+	move_to(vt, vt->saved_x, vt->saved_y);
+	vt->pen = vt->saved_pen;
+	break;
+    case 'D':
+	line_feed(vt);
+	break;
+    case 'E':
+	vt->x = 0;
+	line_feed(vt);
+	break;
+    case 'M':
+	reverse_index(vt);
+	break;
+    case 'c':
+	vt_reset(vt);
+	break;
+    }
+}
+
+static void
+control (Vt *vt, int c)
+{
+    switch (c) {
+    case '\b':
+	if (vt->x > 0) {
+	    vt->x--;
+	}
+	vt->wrap = 0;
+	break;
+    case '\t':
+	vt->x = (vt->x / 8 + 1) * 8;
+	if (vt->x >= vt->cols) {
+	    vt->x = vt->cols - 1;
+	}
+	break;
+    case '\n':
+    case '\v':
+    case '\f':
+	line_feed(vt);
+	break;
+    case '\r':
+	vt->x = 0;
+	vt->wrap = 0;
+	break;
+    case 0x0e:  /* SO */
+	vt->shift = 1;
+	break;
+    case 0x0f:  /* SI */
+	vt->shift = 0;
+	break;
+    case 0x1b:
+	vt->state = V_ESC;
+	break;
+    }
+}
+
+/* printable character c, or a byte of one in UTF-8 */
+static void
+text (Vt *vt, int c)
+{
+    if (c >= 0x80) {
+	if (c >= 0xc0) {
+	    vt->utf8_left = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : 1;
+	    vt->utf8 = c & (0x3f >> vt->utf8_left);
+	    return;
+	}
+	if (vt->utf8_left == 0) {   /* stray continuation byte */
+	    put(vt, 0xfffd);
+	    return;
+	}
+	vt->utf8 = (vt->utf8 << 6) | (c & 0x3f);
+	if (--vt->utf8_left == 0) {
+	    put(vt, vt->utf8);
+	}
+	return;
+    }
+    vt->utf8_left = 0;
+    if (vt->charset[vt->shift] == '0' && c >= 0x60 && c < 0x7f) {
+	c = line_drawing[c - 0x60];
+    }
+    put(vt, c);
+}
+
+void
+vt_init (Vt *vt, int rows, int cols)
+{
+    memset(vt, 0, sizeof(Vt));
+    vt->rows = rows;
+    vt->cols = cols;
+    vt->screen = emalloc(rows * cols * sizeof(Vt_Cell));
+    vt->other = emalloc(rows * cols * sizeof(Vt_Cell));
+    vt->dirty = emalloc(rows * cols);
+    vt_reset(vt);
+}
+
+void
+vt_free (Vt *vt)
+{
+    free(vt->screen);
+    free(vt->other);
+    free(vt->dirty);
+}
+
+/* back to the state of a terminal just switched on, all cells dirty */
+void
+vt_reset (Vt *vt)
+{
+    int n = vt->rows * vt->cols;
+
+    if (vt->alt) {
+	switch_screen(vt, 0);
+    }
+    lose_screen(vt, 0, vt->rows);
+    memset(&vt->pen, 0, sizeof(Vt_Cell));
+    fill(vt, 0, n, blank(vt));
+    memcpy(vt->other, vt->screen, n * sizeof(Vt_Cell));
+    vt->x = vt->y = vt->wrap = 0;
+    vt->top = 0;
+    vt->bottom = vt->rows - 1;
+    vt->cursor_hidden = vt->autowrap_off = vt->origin = 0;
+    vt->saved_x = vt->saved_y = 0;
+    vt->saved_pen = vt->pen;
+    vt->charset[0] = vt->charset[1] = 'B';
+    vt->shift = 0;
+    vt->state = V_TEXT;
+    vt->utf8_left = 0;
+}
+
+/* play len bytes of output into vt */
+void
+vt_write (Vt *vt, const char *buf, long len)
+{
+    const unsigned char *p = (const unsigned char *) buf, *end = p + len;
+    int c;
+
+    while (p < end) {
+	c = *p++;
+	if (vt->state == V_TEXT) {
+	    if (c >= 0x20 && c < 0x7f && vt->utf8_left == 0 && 
+		vt->charset[vt->shift] != '0') {
+		/* a run of ASCII, the usual case */
+		put(vt, c);
+		while (p < end && *p >= 0x20 && *p < 0x7f) {
+		    put(vt, *p++);
+		}
+	    } else if (c < 0x20 || c == 0x7f) {
+		control(vt, c);
+	    } else {
+		text(vt, c);
+	    }
+	    continue;
+	}
+	if (c == 0x18 || c == 0x1a) {   /* CAN and SUB cancel */
+	    vt->state = V_TEXT;
+	    continue;
+	}
+	switch (vt->state) {
+	case V_ESC:
+	    vt->state = V_TEXT;
+	    if (c == '[') {
+		vt->state = V_CSI;
+		vt->nparams = 0;
+		vt->private = vt->intermediate = 0;
+	    } else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') {
+		vt->state = V_STRING;
+	    } else if (c >= 0x20 && c < 0x30) {
+		vt->state = V_ESC_INTER;
+		vt->intermediate = c;
+	    } else if (c == 0x1b) {
+		vt->state = V_ESC;
+	    } else if (c < 0x20) {
+		control(vt, c);
+		vt->state = V_ESC;
+	    } else {
+		esc(vt, c);
+	    }
+	    break;
+	case V_ESC_INTER:
+	    if (c >= 0x30) {
+		vt->state = V_TEXT;
+		if (vt->intermediate == '(' || vt->intermediate == ')') {
+		    vt->charset[vt->intermediate == ')'] = c;
+		}
+	    } else if (c == 0x1b) {
+		vt->state = V_ESC;
+	    }
+	    break;
+	case V_CSI:
+	    if (c >= '0' && c <= '9') {
+		if (vt->nparams == 0) {
+		    vt->params[vt->nparams++] = 0;
+		}
+		if (vt->params[vt->nparams - 1] < 100000) {
+		    vt->params[vt->nparams - 1] = 10 * vt->params[vt->nparams - 1] + c - '0';
+		}
+	    } else if (c == ';' || c == ':') {
+		if (vt->nparams == 0) {
+		    vt->params[vt->nparams++] = 0;
+		}
+		if (vt->nparams < VT_PARAMS) {
+		    vt->params[vt->nparams++] = 0;
+		}
+	    } else if (c >= 0x3c && c <= 0x3f) {
+		vt->private = c;
+	    } else if (c >= 0x20 && c < 0x30) {
+		vt->intermediate = c;
+	    } else if (c >= 0x40 && c <= 0x7e) {
+		vt->state = V_TEXT;
+		csi(vt, c);
+	    } else if (c == 0x1b) {
+		vt->state = V_ESC;
+	    } else if (c < 0x20) {
+		control(vt, c);     /* done in the middle, as terminals do */
+	    }
+	    break;
+	case V_STRING:
+	    if (c == '\a') {
+		vt->state = V_TEXT;
+	    } else if (c == 0x1b) {
+		vt->state = V_STRING_ESC;
+	    }
+	    break;
+	case V_STRING_ESC:
+	    vt->state = c == '\\' ? V_TEXT : V_STRING;
+	    break;
+	}
+    }
+}
+
+/* mark all cells clean */
+void
+vt_clean (Vt *vt)
+{
+    memset(vt->dirty, 0, vt->rows * vt->cols);
+}
+
+/* pass what the screen shows to lost(), as at the end of a recording */
+void
+vt_flush (Vt *vt)
+{
+    lose_screen(vt, 0, vt->rows);
+}
+
+/* line of cols cells in UTF-8 to buf, of at least 4 * cols + 1 bytes,
+    without trailing blanks. Returns its length. */
+int
+vt_line_text (const Vt_Cell *line, int cols, char *buf)
+{
+    char *p = buf;
+    unsigned int ch;
+    int x;
+
+    while (cols > 0 && line[cols - 1].ch == ' ') {
+	cols--;
+    }
+    for (x = 0; x < cols; x++) {
+	ch = line[x].ch;
+	if (ch < 0x80) {
+	    *p++ = ch;
+	} else if (ch < 0x800) {
+	    *p++ = 0xc0 | (ch >> 6);
+	    *p++ = 0x80 | (ch & 0x3f);
+	} else if (ch < 0x10000) {
+	    *p++ = 0xe0 | (ch >> 12);
+	    *p++ = 0x80 | ((ch >> 6) & 0x3f);
+	    *p++ = 0x80 | (ch & 0x3f);
+	} else {
+	    *p++ = 0xf0 | ((ch >> 18) & 0x07);
+	    *p++ = 0x80 | ((ch >> 12) & 0x3f);
+	    *p++ = 0x80 | ((ch >> 6) & 0x3f);
+	    *p++ = 0x80 | (ch & 0x3f);
+	}
+    }
+    *p = 0;
+    return p - buf;
+}
+
+/* DEC line drawing char that shows as ch, 0 if none */
+int
+vt_line_drawing (unsigned int ch)
+{
+    int i;
+
+    for (i = 0; i < sizeof(line_drawing) / sizeof(line_drawing[0]); i++) {
+	if (line_drawing[i] == ch) {
+	    return 0x60 + i;
+	}
+    }
+    return 0;
+}
+
+/* "COLSxROWS" to rows and cols, 0 if it is no size */
+int
+vt_parse_size (const char *arg, int *rows, int *cols)
+{
+    char x;
+
+    if (sscanf(arg, "%dx%d%c", cols, rows, &x) != 2 ||
+	*rows < 1 || *cols < 1 || *rows > VT_MAX || *cols > VT_MAX) {
+	return 0;
+    }
+    return 1;
+}
+
+/* RGB of xterm color index */
+unsigned int
+vt_color (int index)
+{
+    static const unsigned int base[16] = {
+	0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+	0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff
+    };
+    static const int level[6] = { 0, 0x5f, 0x87, 0xaf, 0xd7, 0xff };
+
+    if (index < 16) {
+	return base[index];
+    }
+    if (index < 232) {
+	index -= 16;
+	return level[index / 36] << 16 | level[index / 6 % 6] << 8 | level[index % 6];
+    }
+    index = 8 + 10 * (index - 232);
+    return index << 16 | index << 8 | index;
+}
+
+/* RGB of foreground and background of cell c as shown, with reverse 
+    video and bold as bright */
+void
+vt_cell_colors (const Vt_Cell *c, unsigned int *fg, unsigned int *bg)
+{
+    int index = c->fg;
+    unsigned int t;
+
+    if ((c->attr & VT_BOLD) && index < 8) {
+	index += 8;
+    }
+    *fg = c->attr & VT_FG ? vt_color(index) : VT_DEFAULT_FG;
+    *bg = c->attr & VT_BG ? vt_color(c->bg) : VT_DEFAULT_BG;
+    if (c->attr & VT_REVERSE) {
+	t = *fg;
+	*fg = *bg;
+	*bg = t;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef __TTYREC_VT_H__
+#define __TTYREC_VT_H__
+
+#include "ttyrec.h"
+
+void    vt_init         (Vt *vt, int rows, int cols);
+void    vt_free         (Vt *vt);
+void    vt_reset        (Vt *vt);
+void    vt_write        (Vt *vt, const char *buf, long len);
+void    vt_clean        (Vt *vt);
+void    vt_flush        (Vt *vt);
+int     vt_line_text    (const Vt_Cell *line, int cols, char *buf);
+int     vt_parse_size   (const char *arg, int *rows, int *cols);
+int     vt_line_drawing (unsigned int ch);
+unsigned int vt_color   (int index);
+void    vt_cell_colors  (const Vt_Cell *c, unsigned int *fg, unsigned int *bg);
+
+#endif
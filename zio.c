@@ -0,0 +1,757 @@
+/*
+ * Copyright (c) 1980 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* 
+ * zio: compressed recordings, read through a stdio stream
+ * 
+ * A compressed recording is inflated whole into memory when opened, and 
+ * read from there with fseek() and ftell() working as on a file. The 
+ * recordings are small, so this costs little, and one read of the 
+ * compressed file replaces many small reads of the plain one.
+ * 
+ * Dictionaries are loaded once and kept for the rest of the run, so 
+ * going through an archive that shares one reads it only once.
+ */
+
+#define _GNU_SOURCE     /* fopencookie() */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdint.h>
+#include <zlib.h>
+#include <pthread.h>
+
+#include "ttyrec.h"
+#include "io.h"
+#include "zio.h"
+
+#define ZIO_CHUNK   (1 << 16)   /* output buffer of deflate */
+
+/* read only stream on a malloc()ed buffer, which fclose() frees */
+typedef struct MEMCOOKIE
+{
+    char *data;
+    size_t size;
+    off64_t pos;
+} MemCookie;
+
+static ssize_t
+mem_read (void *cookie, char *buf, size_t size)
+{
+    MemCookie *mc = cookie;
+
+    if (mc->pos >= mc->size) {
+	return 0;
+    }
+    if (size > mc->size - mc->pos) {
+	size = mc->size - mc->pos;
+    }
+    memcpy(buf, mc->data + mc->pos, size);
+    mc->pos += size;
+    return size;
+}
+
+static int
+mem_seek (void *cookie, off64_t *offset, int whence)
+{
+    MemCookie *mc = cookie;
+    off64_t pos = *offset;
+
+    if (whence == SEEK_CUR) {
+	pos += mc->pos;
+    } else if (whence == SEEK_END) {
+	pos += mc->size;
+    }
+    if (pos < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    *offset = mc->pos = pos;
+    return 0;
+}
+
+static int
+mem_close (void *cookie)
+{
+    MemCookie *mc = cookie;
+
+    free(mc->data);
+    free(mc);
+    return 0;
+}
+
+FILE *
+mem_stream (char *data, size_t size)
+{
+    cookie_io_functions_t io = {mem_read, NULL, mem_seek, mem_close};
+    MemCookie *mc = emalloc(sizeof(MemCookie));
+    FILE *fp;
+
+    mc->data = data;
+    mc->size = size;
+    mc->pos = 0;
+    fp = fopencookie(mc, "r", io);
+    if (fp == NULL) {
+	fprintf(stderr, "%s: fopencookie failed: %s\n", get_progname(), strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+/* dictionaries loaded so far, by streams opened in any thread */
+static Tty_Dict **dicts = NULL;
+static int dict_count = 0;
+static pthread_mutex_t dict_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* read a dictionary file, NULL if it cannot be opened */
+Tty_Dict *
+dict_load (const char *path)
+{
+    unsigned char hdr[TTYDICT_HEADER];
+    Tty_Dict *d;
+    char *tmp;
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL) {
+	return NULL;
+    }
+    d = emalloc(sizeof(Tty_Dict));
+    d->data = emalloc(TTYDICT_MAX);
+    if (fread(hdr, 1, TTYDICT_HEADER, fp) != TTYDICT_HEADER ||
+	memcmp(hdr, TTYDICT_MAGIC, 8) != 0 || hdr[8] != TTYDICT_VERSION) {
+	fprintf(stderr, "%s: %s: not a dictionary, or unsupported version\n", 
+		get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    d->id = get_le(hdr + 12, 4);
+    d->size = fread(d->data, 1, TTYDICT_MAX, fp);
+    fclose(fp);
+    if (adler32(adler32(0, NULL, 0), d->data, d->size) != d->id) {
+	fprintf(stderr, "%s: %s: dictionary is corrupt\n", get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    tmp = strdup(path);
+    d->name = strdup(basename(tmp));
+    free(tmp);
+    return d;
+}
+
+/* write a dictionary file, 0 on failure */
+int
+dict_save (const char *path, const unsigned char *data, int size)
+{
+    unsigned char hdr[TTYDICT_HEADER];
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL) {
+	return 0;
+    }
+    memset(hdr, 0, TTYDICT_HEADER);
+    memcpy(hdr, TTYDICT_MAGIC, 8);
+    hdr[8] = TTYDICT_VERSION;
+    put_le(hdr + 12, adler32(adler32(0, NULL, 0), data, size), 4);
+    if (fwrite(hdr, 1, TTYDICT_HEADER, fp) != TTYDICT_HEADER ||
+	fwrite(data, 1, size, fp) != size) {
+	fclose(fp);
+	return 0;
+    }
+    return fclose(fp) == 0;
+}
+
+/* try dir/name as the dictionary with id, keep it if it is */
+static Tty_Dict *
+dict_try (const char *dir, int dir_len, const char *name, unsigned int id)
+{
+    char *path = emalloc(dir_len + strlen(name) + 2);
+    Tty_Dict *d;
+
+    sprintf(path, "%.*s/%s", dir_len, dir, name);
+    d = dict_load(path);
+    free(path);
+    if (d == NULL) {
+	return NULL;
+    }
+    if (d->id != id) {
+	free(d->name);
+	free(d->data);
+	free(d);
+	return NULL;
+    }
+    dicts = realloc(dicts, (dict_count + 1) * sizeof(Tty_Dict *));
+    if (dicts == NULL) {
+	perror("realloc");
+	exit(EXIT_FAILURE);
+    }
+    dicts[dict_count++] = d;
+    return d;
+}
+
+/* dictionary with id, called name, for recording at path near. Looked 
+    for among those loaded, next to the recording, then in TTYDICT_PATH.
+    NULL if not found. */
+static Tty_Dict *
+dict_find_locked (unsigned int id, const char *name, const char *near)
+{
+    const char *p, *dirs;
+    char *tmp;
+    Tty_Dict *d;
+    int i;
+
+    for (i = 0; i < dict_count; i++) {
+	if (dicts[i]->id == id) {
+	    return dicts[i];
+	}
+    }
+    /* a name with directories in it could point anywhere */
+    if (strchr(name, '/') != NULL || *name == '\0') {
+	return NULL;
+    }
+    tmp = strdup(near);
+    p = dirname(tmp);
+    d = dict_try(p, strlen(p), name, id);
+    free(tmp);
+    if (d != NULL || (dirs = getenv(TTYDICT_PATH)) == NULL) {
+	return d;
+    }
+    while (*dirs) {
+	p = strchr(dirs, ':');
+	if (p == NULL) {
+	    p = dirs + strlen(dirs);
+	}
+	if (p > dirs && (d = dict_try(dirs, p - dirs, name, id)) != NULL) {
+	    return d;
+	}
+	dirs = *p ? p + 1 : p;
+    }
+    return NULL;
+}
+
+Tty_Dict *
+dict_find (unsigned int id, const char *name, const char *near)
+{
+    Tty_Dict *d;
+
+    pthread_mutex_lock(&dict_lock);
+    d = dict_find_locked(id, name, near);
+    pthread_mutex_unlock(&dict_lock);
+    return d;
+}
+
+/* fp is a compressed recording just past magic, read from path. Returns
+    a stream of its content instead, fp is closed. */
+FILE *
+zio_open (FILE *fp, const char *path)
+{
+    unsigned char hdr[TTYZ_HEADER];
+    unsigned char *in;
+    char *out, *name;
+    unsigned long long size;
+    long start, in_size;
+    unsigned int id;
+    int name_len, ret;
+    z_stream zs;
+
+    if (fread(hdr + 8, 1, TTYZ_HEADER - 8, fp) != TTYZ_HEADER - 8 ||
+	hdr[8] != TTYZ_VERSION) {
+	fprintf(stderr, "%s: %s: unsupported compressed recording version\n", 
+		get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    id = get_le(hdr + 12, 4);
+    size = get_le(hdr + 16, 8);
+    name_len = get_le(hdr + 24, 2);
+    name = emalloc(name_len + 1);
+    name[fread(name, 1, name_len, fp)] = '\0';
+
+    /* the compressed stream in one read */
+    start = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    in_size = ftell(fp) - start;
+    fseek(fp, start, SEEK_SET);
+    in = in_size < 0 ? NULL : emalloc(in_size + 1);
+    if (in == NULL || fread(in, 1, in_size, fp) != in_size || size >= SIZE_MAX) {
+	fprintf(stderr, "%s: %s: truncated compressed recording\n", 
+		get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    efclose(fp);
+
+    out = emalloc(size + 1);
+    memset(&zs, 0, sizeof(zs));
+    zs.next_in = in;
+    zs.next_out = (unsigned char *) out;
+    if (inflateInit(&zs) != Z_OK) {
+	fprintf(stderr, "%s: inflateInit failed\n", get_progname());
+	exit(EXIT_FAILURE);
+    }
+    do {
+	/* avail_* are only 32 bits */
+	if (zs.avail_in == 0) {
+	    zs.avail_in = in_size - zs.total_in > UINT_MAX ? UINT_MAX : in_size - zs.total_in;
+	}
+	if (zs.avail_out == 0) {
+	    zs.avail_out = size - zs.total_out > UINT_MAX ? UINT_MAX : size - zs.total_out;
+	}
+	ret = inflate(&zs, Z_NO_FLUSH);
+	if (ret == Z_NEED_DICT) {
+	    Tty_Dict *d = dict_find(id, name, path);
+	    if (d == NULL || zs.adler != id) {
+		fprintf(stderr, "%s: %s: dictionary %s not found\n", 
+			get_progname(), path, name);
+		exit(EXIT_FAILURE);
+	    }
+	    inflateSetDictionary(&zs, d->data, d->size);
+	    ret = Z_OK;
+	}
+    } while (ret == Z_OK);
+    if (ret != Z_STREAM_END || zs.total_out != size) {
+	fprintf(stderr, "%s: %s: corrupt compressed recording\n", get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    inflateEnd(&zs);
+    free(in);
+    free(name);
+    return mem_stream(out, size);
+}
+
+/* write data compressed with dict, which may be NULL, to fp. 0 on failure */
+int
+zio_write (FILE *fp, const char *data, size_t size, const Tty_Dict *dict)
+{
+    unsigned char hdr[TTYZ_HEADER], buf[ZIO_CHUNK];
+    const char *name = dict ? dict->name : "";
+    size_t fed = 0;     /* zs.total_in counts the dictionary too */
+    z_stream zs;
+    int ret;
+
+    memset(hdr, 0, TTYZ_HEADER);
+    memcpy(hdr, TTYZ_MAGIC, 8);
+    hdr[8] = TTYZ_VERSION;
+    put_le(hdr + 12, dict ? dict->id : 0, 4);
+    put_le(hdr + 16, size, 8);
+    put_le(hdr + 24, strlen(name), 2);
+    if (fwrite(hdr, 1, TTYZ_HEADER, fp) != TTYZ_HEADER ||
+	fwrite(name, 1, strlen(name), fp) != strlen(name)) {
+	return 0;
+    }
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK ||
+	(dict && deflateSetDictionary(&zs, dict->data, dict->size) != Z_OK)) {
+	return 0;
+    }
+    zs.next_in = (unsigned char *) data;
+    do {
+	if (zs.avail_in == 0) {
+	    zs.avail_in = size - fed > UINT_MAX ? UINT_MAX : size - fed;
+	    fed += zs.avail_in;
+	}
+	zs.next_out = buf;
+	zs.avail_out = ZIO_CHUNK;
+	ret = deflate(&zs, fed == size ? Z_FINISH : Z_NO_FLUSH);
+	if (fwrite(buf, 1, ZIO_CHUNK - zs.avail_out, fp) != ZIO_CHUNK - zs.avail_out) {
+	    deflateEnd(&zs);
+	    return 0;
+	}
+    } while (ret == Z_OK);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+/* gzip: read through an inflating stream, which keeps checkpoints of the
+    inflate state every GZ_SPAN bytes of output as it goes, zran style.
+    Checkpoints are kept by path for the rest of the run, so once a file
+    has been read through (say, by the indexer), seeking in it later 
+    inflates at most GZ_SPAN bytes, not everything from the start. */
+#define GZ_SPAN     (1 << 20)   /* bytes of output between checkpoints */
+#define GZ_WINDOW   32768       /* deflate window, saved at checkpoints */
+#define GZ_CHUNK    (1 << 14)   /* of input read at a time */
+#define GZ_OUT      (1 << 16)   /* of output kept, stdio seeks back a bit */
+
+typedef struct GZPOINT
+{
+    off64_t out;                /* offset in uncompressed data */
+    off64_t in;                 /* offset in file of first whole byte */
+    int bits;                   /* bits of the byte before it still unused */
+    unsigned char *window;
+    unsigned int window_size;
+} Gz_Point;
+
+typedef struct GZINDEX
+{
+    char *path;
+    Gz_Point *points;           /* in order of out */
+    int count, alloc;
+    off64_t size;               /* uncompressed, -1 until read to end */
+    pthread_mutex_t lock;       /* streams of one path share checkpoints */
+} Gz_Index;
+
+typedef struct GZCOOKIE
+{
+    FILE *fp;
+    Gz_Index *idx;
+    z_stream zs;
+    int raw;                    /* inflating raw deflate from a checkpoint */
+    int eof;
+    off64_t pos;                /* next byte to hand out */
+    off64_t zpos;               /* next byte inflate() gives */
+    off64_t in_pos;             /* offset in file after input read */
+    off64_t out_start;          /* offset of out[0], out ends at zpos */
+    int out_len;
+    unsigned char in[GZ_CHUNK];
+    unsigned char out[GZ_OUT];
+} GzCookie;
+
+static Gz_Index **gz_indexes = NULL;
+static int gz_index_count = 0;
+static pthread_mutex_t gz_lock = PTHREAD_MUTEX_INITIALIZER;    /* for the above */
+
+static Gz_Index *
+gz_index (const char *path)
+{
+    Gz_Index *idx;
+    int i;
+
+    pthread_mutex_lock(&gz_lock);
+    for (i = 0; i < gz_index_count; i++) {
+	if (strcmp(gz_indexes[i]->path, path) == 0) {
+	    pthread_mutex_unlock(&gz_lock);
+	    return gz_indexes[i];
+	}
+    }
+    idx = emalloc(sizeof(Gz_Index));
+    memset(idx, 0, sizeof(Gz_Index));
+    idx->path = strdup(path);
+    idx->size = -1;
+    pthread_mutex_init(&idx->lock, NULL);
+    gz_indexes = realloc(gz_indexes, (gz_index_count + 1) * sizeof(Gz_Index *));
+    if (gz_indexes == NULL) {
+	perror("realloc");
+	exit(EXIT_FAILURE);
+    }
+    gz_indexes[gz_index_count++] = idx;
+    pthread_mutex_unlock(&gz_lock);
+    return idx;
+}
+
+/* uncompressed size of idx, -1 until read to end */
+static off64_t
+gz_size (Gz_Index *idx)
+{
+    off64_t size;
+
+    pthread_mutex_lock(&idx->lock);
+    size = idx->size;
+    pthread_mutex_unlock(&idx->lock);
+    return size;
+}
+
+/* last checkpoint at or before out, NULL if none; idx->lock is held */
+static Gz_Point *
+gz_point (Gz_Index *idx, off64_t out)
+{
+    int lo = 0, hi = idx->count;
+
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+	if (idx->points[mid].out <= out) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return lo ? &idx->points[lo - 1] : NULL;
+}
+
+/* at a block boundary: add a checkpoint if we are GZ_SPAN past the last */
+static void
+gz_checkpoint (GzCookie *gc)
+{
+    Gz_Index *idx = gc->idx;
+    Gz_Point *p;
+
+    pthread_mutex_lock(&idx->lock);
+    if (gc->zpos < (idx->count ? idx->points[idx->count - 1].out : 0) + GZ_SPAN) {
+	pthread_mutex_unlock(&idx->lock);
+	return;
+    }
+    if (idx->count == idx->alloc) {
+	idx->alloc = idx->alloc ? idx->alloc * 2 : 16;
+	idx->points = realloc(idx->points, idx->alloc * sizeof(Gz_Point));
+	if (idx->points == NULL) {
+	    perror("realloc");
+	    exit(EXIT_FAILURE);
+	}
+    }
+    p = &idx->points[idx->count];
+    p->window = emalloc(GZ_WINDOW);
+    p->window_size = GZ_WINDOW;
+    if (inflateGetDictionary(&gc->zs, p->window, &p->window_size) != Z_OK) {
+	free(p->window);
+    } else {
+	p->out = gc->zpos;
+	p->in = gc->in_pos - gc->zs.avail_in;
+	p->bits = gc->zs.data_type & 7;
+	idx->count++;
+    }
+    pthread_mutex_unlock(&idx->lock);
+}
+
+/* set up inflating from checkpoint p, or the start if NULL */
+static int
+gz_restart_at (GzCookie *gc, const Gz_Point *p)
+{
+    gc->zs.avail_in = 0;
+    gc->eof = 0;
+    gc->out_len = 0;
+    gc->out_start = p ? p->out : 0;
+    if (p == NULL) {
+	gc->raw = 0;
+	gc->zpos = gc->in_pos = 0;
+	return inflateReset2(&gc->zs, 15 + 32) == Z_OK && fseeko(gc->fp, 0, SEEK_SET) == 0;
+    }
+    gc->raw = 1;
+    gc->zpos = p->out;
+    gc->in_pos = p->in - (p->bits ? 1 : 0);
+    if (inflateReset2(&gc->zs, -15) != Z_OK || fseeko(gc->fp, gc->in_pos, SEEK_SET) != 0) {
+	return 0;
+    }
+    if (p->bits) {
+	int c = getc(gc->fp);
+	if (c == EOF) {
+	    return 0;
+	}
+	gc->in_pos++;
+	inflatePrime(&gc->zs, p->bits, c >> (8 - p->bits));
+    }
+    return inflateSetDictionary(&gc->zs, p->window, p->window_size) == Z_OK;
+}
+
+/* set up inflating from the checkpoint nearest before out */
+static int
+gz_restart (GzCookie *gc, off64_t out)
+{
+    int ret;
+
+    pthread_mutex_lock(&gc->idx->lock);
+    ret = gz_restart_at(gc, gz_point(gc->idx, out));
+    pthread_mutex_unlock(&gc->idx->lock);
+    return ret;
+}
+
+/* inflate up to size bytes into buf, returns bytes given, 0 at end, -1
+    on error */
+static ssize_t
+gz_inflate (GzCookie *gc, unsigned char *buf, size_t size)
+{
+    unsigned int avail;
+    int ret;
+
+    gc->zs.next_out = buf;
+    gc->zs.avail_out = size;
+    while (gc->zs.avail_out == size && !gc->eof) {
+	if (gc->zs.avail_in == 0) {
+	    size_t n = fread(gc->in, 1, GZ_CHUNK, gc->fp);
+	    if (n == 0) {
+		if (ferror(gc->fp)) {
+		    return -1;
+		}
+		/* a truncated file ends here, too */
+		gc->eof = 1;
+		pthread_mutex_lock(&gc->idx->lock);
+		if (gc->idx->size < 0) {
+		    gc->idx->size = gc->zpos;
+		}
+		pthread_mutex_unlock(&gc->idx->lock);
+		break;
+	    }
+	    gc->in_pos += n;
+	    gc->zs.next_in = gc->in;
+	    gc->zs.avail_in = n;
+	}
+	avail = gc->zs.avail_out;
+	ret = inflate(&gc->zs, Z_BLOCK);
+	if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+	    return -1;
+	}
+	gc->zpos += avail - gc->zs.avail_out;
+	if (ret == Z_STREAM_END) {
+	    /* raw inflate leaves the member trailer, gzip mode reads it */
+	    if (gc->raw) {
+		int skip = 8;
+		while (skip--) {
+		    if (gc->zs.avail_in == 0) {
+			size_t n = fread(gc->in, 1, GZ_CHUNK, gc->fp);
+			if (n == 0) {
+			    break;
+			}
+			gc->in_pos += n;
+			gc->zs.next_in = gc->in;
+			gc->zs.avail_in = n;
+		    }
+		    gc->zs.next_in++;
+		    gc->zs.avail_in--;
+		}
+	    }
+	    gc->raw = 0;
+	    inflateReset2(&gc->zs, 15 + 32);
+	} else if ((gc->zs.data_type & 128) && !(gc->zs.data_type & 64)) {
+	    gz_checkpoint(gc);
+	}
+    }
+    return size - gc->zs.avail_out;
+}
+
+/* inflate more into out, keeping the latter half of it. Returns bytes
+    added, 0 at end, -1 on error */
+static ssize_t
+gz_fill (GzCookie *gc)
+{
+    ssize_t n;
+
+    if (gc->out_len == GZ_OUT) {
+	memmove(gc->out, gc->out + GZ_OUT / 2, GZ_OUT / 2);
+	gc->out_start += GZ_OUT / 2;
+	gc->out_len = GZ_OUT / 2;
+    }
+    n = gz_inflate(gc, gc->out + gc->out_len, GZ_OUT - gc->out_len);
+    if (n > 0) {
+	gc->out_len += n;
+    }
+    return n;
+}
+
+static ssize_t
+gz_read (void *cookie, char *buf, size_t size)
+{
+    GzCookie *gc = cookie;
+    Gz_Point *p;
+    off64_t point;	/* of checkpoint before pos, -1 if none */
+    ssize_t n;
+
+    /* points may be moved by another stream adding one */
+    pthread_mutex_lock(&gc->idx->lock);
+    p = gz_point(gc->idx, gc->pos);
+    point = p ? p->out : -1;
+    pthread_mutex_unlock(&gc->idx->lock);
+    /* back past what is kept, or ahead past a checkpoint: start from 
+	the checkpoint */
+    if (gc->pos < gc->out_start || point > gc->zpos) {
+	if (!gz_restart(gc, gc->pos)) {
+	    return -1;
+	}
+    }
+    while (gc->pos >= gc->zpos) {
+	if (gc->pos - gc->zpos > GZ_OUT) {
+	    gc->out_len = 0;	/* skipping, none of it is wanted */
+	    gc->out_start = gc->zpos;
+	}
+	if ((n = gz_fill(gc)) <= 0) {
+	    return n;
+	}
+    }
+    n = gc->zpos - gc->pos;
+    if (n > size) {
+	n = size;
+    }
+    memcpy(buf, gc->out + (gc->pos - gc->out_start), n);
+    gc->pos += n;
+    return n;
+}
+
+static int
+gz_seek (void *cookie, off64_t *offset, int whence)
+{
+    GzCookie *gc = cookie;
+    off64_t pos = *offset;
+
+    if (whence == SEEK_CUR) {
+	pos += gc->pos;
+    } else if (whence == SEEK_END) {
+	/* size is known only after reading to the end once */
+	while (gz_size(gc->idx) < 0) {
+	    if (gc->eof && !gz_restart(gc, gc->zpos)) {
+		return -1;
+	    }
+	    if (gz_fill(gc) < 0) {
+		return -1;
+	    }
+	}
+	pos += gz_size(gc->idx);
+    }
+    if (pos < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    *offset = gc->pos = pos;
+    return 0;
+}
+
+static int
+gz_close (void *cookie)
+{
+    GzCookie *gc = cookie;
+    int ret = fclose(gc->fp);
+
+    inflateEnd(&gc->zs);
+    free(gc);
+    return ret;
+}
+
+/* fp is a gzip file read from path, returns a seekable stream of its 
+    content instead, fp is closed with it */
+FILE *
+gz_open (FILE *fp, const char *path)
+{
+    cookie_io_functions_t io = {gz_read, NULL, gz_seek, gz_close};
+    GzCookie *gc = emalloc(sizeof(GzCookie));
+    FILE *zfp;
+
+    memset(gc, 0, sizeof(GzCookie));
+    gc->fp = fp;
+    gc->idx = gz_index(path);
+    if (inflateInit2(&gc->zs, 15 + 32) != Z_OK || !gz_restart(gc, 0)) {
+	fprintf(stderr, "%s: %s: cannot inflate\n", get_progname(), path);
+	exit(EXIT_FAILURE);
+    }
+    zfp = fopencookie(gc, "r", io);
+    if (zfp == NULL) {
+	fprintf(stderr, "%s: fopencookie failed: %s\n", get_progname(), strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    return zfp;
+}
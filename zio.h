@@ -0,0 +1,16 @@
+#ifndef __TTYREC_ZIO_H__
+#define __TTYREC_ZIO_H__
+
+#include <stdio.h>
+#include "ttyrec.h"
+
+FILE*   mem_stream      (char *data, size_t size);
+FILE*   zio_open        (FILE *fp, const char *path);
+FILE*   gz_open         (FILE *fp, const char *path);
+int     zio_write       (FILE *fp, const char *data, size_t size,
+                         const Tty_Dict *dict);
+Tty_Dict* dict_load     (const char *path);
+Tty_Dict* dict_find     (unsigned int id, const char *name, const char *near);
+int     dict_save       (const char *path, const unsigned char *data, int size);
+
+#endif